@@ -5,6 +5,9 @@
 
 namespace toccata {
 
+    class Library;
+    struct MusicSegment;
+
     class BenchmarkingTest {
     public:
         BenchmarkingTest();
@@ -15,6 +18,12 @@ namespace toccata {
 
         virtual void Run() = 0;
 
+    protected:
+        // Plays up to the given number of bars from the first bar of the
+        // library, following the first successor of each bar, with every
+        // bar jittered by a few milliseconds
+        static void GenerateInput(Library *library, int barCount, unsigned int seed, MusicSegment *target);
+
     protected:
         std::string m_name;
     };
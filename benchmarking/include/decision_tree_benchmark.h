@@ -0,0 +1,25 @@
+#ifndef TOCCATA_BENCHMARKING_DECISION_TREE_BENCHMARK_H
+#define TOCCATA_BENCHMARKING_DECISION_TREE_BENCHMARK_H
+
+#include "benchmarking_test.h"
+
+namespace toccata {
+
+    class DecisionTreeBenchmark : public BenchmarkingTest {
+    public:
+        DecisionTreeBenchmark();
+        ~DecisionTreeBenchmark();
+
+        virtual void Run();
+
+        // Number of heap allocations made by the whole process so far
+        static long long GetHeapAllocationCount();
+
+    protected:
+        // Average time per note playing a known piece from a large library
+        double MeasureNoteTime(bool follow, long long *followedPasses);
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_BENCHMARKING_DECISION_TREE_BENCHMARK_H */
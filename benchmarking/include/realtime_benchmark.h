@@ -0,0 +1,30 @@
+#ifndef TOCCATA_BENCHMARKING_REALTIME_BENCHMARK_H
+#define TOCCATA_BENCHMARKING_REALTIME_BENCHMARK_H
+
+#include "benchmarking_test.h"
+
+#include "../../include/thread_utilities.h"
+#include "../../include/latency_histogram.h"
+
+namespace toccata {
+
+    // Compares note-to-decision latency with the decision threads' real-time
+    // mode off and on. Notes are fed at playing speed so that the threads
+    // park between notes the way they do in the application.
+    class RealtimeBenchmark : public BenchmarkingTest {
+    public:
+        static constexpr int ThreadCount = 4;
+
+    public:
+        RealtimeBenchmark();
+        ~RealtimeBenchmark();
+
+        virtual void Run();
+
+    protected:
+        LatencyHistogram Measure(const ThreadUtilities::RealtimeSettings &settings, int *failures);
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_BENCHMARKING_REALTIME_BENCHMARK_H */
@@ -1,5 +1,8 @@
 #include "../include/benchmarking_test.h"
 
+#include "../../include/library.h"
+#include "../../include/segment_generator.h"
+
 toccata::BenchmarkingTest::BenchmarkingTest() {
     m_name = "";
 }
@@ -7,3 +10,26 @@ toccata::BenchmarkingTest::BenchmarkingTest() {
 toccata::BenchmarkingTest::~BenchmarkingTest() {
     /* void */
 }
+
+void toccata::BenchmarkingTest::GenerateInput(
+    Library *library, int barCount, unsigned int seed, MusicSegment *target)
+{
+    SegmentGenerator segmentGenerator;
+    segmentGenerator.Seed(seed);
+
+    target->Length = 0;
+    target->PulseUnit = library->GetBar(0)->GetSegment()->PulseUnit;
+
+    Bar *current = library->GetBar(0);
+    for (int i = 0; i < barCount && current != nullptr; ++i) {
+        MusicSegment segment;
+        SegmentGenerator::Copy(current->GetSegment(), &segment);
+        segmentGenerator.Jitter(&segment, 5);
+
+        SegmentGenerator::Append(target, &segment);
+
+        current = (current->GetNextCount() > 0)
+            ? current->GetNext(0)
+            : nullptr;
+    }
+}
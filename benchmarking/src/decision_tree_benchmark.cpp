@@ -0,0 +1,147 @@
+#include "../include/decision_tree_benchmark.h"
+
+#include "../../include/decision_tree.h"
+#include "../../include/library.h"
+#include "../../include/song_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+
+    std::atomic<long long> g_heapAllocations(0);
+
+} /* namespace */
+
+// Every allocation in the benchmark executable is counted so that the
+// allocations made by DecisionTree::Process can be measured directly
+void *operator new(size_t size) {
+    ++g_heapAllocations;
+
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) throw std::bad_alloc();
+
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void *memory) noexcept {
+    operator delete(memory);
+}
+
+toccata::DecisionTreeBenchmark::DecisionTreeBenchmark() {
+    m_name = "decision_tree";
+}
+
+toccata::DecisionTreeBenchmark::~DecisionTreeBenchmark() {
+    /* void */
+}
+
+long long toccata::DecisionTreeBenchmark::GetHeapAllocationCount() {
+    return g_heapAllocations;
+}
+
+void toccata::DecisionTreeBenchmark::Run() {
+    constexpr int BarCount = 500;
+
+    Library library;
+
+    SongGenerator songGenerator;
+    songGenerator.Seed(0);
+    songGenerator.GenerateSong(&library, 4, 8);
+
+    MusicSegment inputSegment;
+    GenerateInput(&library, BarCount, 0, &inputSegment);
+
+    DecisionTree tree;
+    tree.SetLibrary(&library);
+    tree.SetInputSegment(&inputSegment);
+    tree.Initialize(1);
+    tree.SpawnThreads();
+
+    const int n = inputSegment.NoteContainer.GetCount();
+
+    long long peakAllocations = 0;
+    const long long initialAllocations = GetHeapAllocationCount();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        const long long allocations = GetHeapAllocationCount();
+        tree.Process(i);
+
+        peakAllocations = std::max(peakAllocations, GetHeapAllocationCount() - allocations);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    const long long totalAllocations = GetHeapAllocationCount() - initialAllocations;
+    const DecisionTree::AllocationStatistics statistics = tree.GetAllocationStatistics();
+
+    std::cout << "Processed " << n << " notes, " << tree.GetDecisionCount() << " decisions\n";
+    std::cout << "Heap allocations per Process call: "
+        << totalAllocations / (double)n << " avg, " << peakAllocations << " peak\n";
+    std::cout << "Decision allocations: " << statistics.DecisionAllocations << "\n";
+    std::cout << "Decision slabs: " << statistics.SlabAllocations
+        << " (" << statistics.PoolCapacity << " slots, "
+        << statistics.LiveDecisions << " live)\n";
+    std::cout << "Test took "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+        << " ms\n";
+
+    tree.KillThreads();
+    tree.Destroy();
+
+    long long followedPasses = 0;
+    const double searchTime = MeasureNoteTime(false, &followedPasses);
+    const double followTime = MeasureNoteTime(true, &followedPasses);
+
+    std::cout << "Known piece, library-wide search: " << searchTime * 1E6 << " us per note\n";
+    std::cout << "Known piece, score following: " << followTime * 1E6 << " us per note ("
+        << followedPasses << " followed passes)\n";
+}
+
+double toccata::DecisionTreeBenchmark::MeasureNoteTime(bool follow, long long *followedPasses) {
+    constexpr int Sections = 128;
+    constexpr int BarCount = 64;
+
+    Library library;
+
+    SongGenerator songGenerator;
+    songGenerator.Seed(0);
+    songGenerator.GenerateSong(&library, Sections, 8);
+
+    MusicSegment inputSegment;
+    GenerateInput(&library, BarCount, 0, &inputSegment);
+
+    DecisionTree tree;
+    tree.SetLibrary(&library);
+    tree.SetInputSegment(&inputSegment);
+    tree.SetFollowerEnabled(follow);
+    tree.Initialize(1);
+    tree.SpawnThreads();
+
+    const int n = inputSegment.NoteContainer.GetCount();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        tree.Process(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    *followedPasses = tree.GetSolverStatistics().FollowedPasses;
+
+    tree.KillThreads();
+    tree.Destroy();
+
+    return std::chrono::duration<double>(end - start).count() / n;
+}
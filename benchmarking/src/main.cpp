@@ -1,7 +1,25 @@
 #include "../include/basic_solve_benchmark.h"
+#include "../include/decision_tree_benchmark.h"
 #include "../include/midi_device_testbench.h"
+#include "../include/realtime_benchmark.h"
+
+#include <string>
+
+int main(int argc, char **argv) {
+    const std::string name = (argc > 1) ? argv[1] : "";
+
+    toccata::DecisionTreeBenchmark decisionTreeBenchmark;
+    if (name == decisionTreeBenchmark.GetName()) {
+        decisionTreeBenchmark.Run();
+        return 0;
+    }
+
+    toccata::RealtimeBenchmark realtimeBenchmark;
+    if (name == realtimeBenchmark.GetName()) {
+        realtimeBenchmark.Run();
+        return 0;
+    }
 
-int main() {
     toccata::MidiDeviceTestbench benchmark;
     benchmark.Run();
 
@@ -85,6 +85,7 @@ void toccata::MidiDeviceTestbench::InitializeMidiInput() {
     toccata::SegmentGenerator::Convert(&stream, &m_library, 0);
 
     m_decisionThread.Initialize(&m_library, 12, pulse, 1.0);
+    m_decisionThread.SetWorkerLimits(1, 12);
     m_decisionThread.StartThreads();
 }
 
@@ -0,0 +1,105 @@
+#include "../include/realtime_benchmark.h"
+
+#include "../../include/decision_thread.h"
+#include "../../include/library.h"
+#include "../../include/song_generator.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+    void PrintDistribution(const char *name, const toccata::LatencyHistogram &histogram, int failures) {
+        std::cout << name << ": "
+            << histogram.GetCount() << " notes, p50 "
+            << histogram.GetPercentile(0.5) * 1E6 << " us, p95 "
+            << histogram.GetPercentile(0.95) * 1E6 << " us, p99 "
+            << histogram.GetPercentile(0.99) * 1E6 << " us, max "
+            << histogram.GetMax() * 1E6 << " us";
+
+        if (failures > 0) {
+            std::cout << " (" << failures << " threads or solvers fell back to default settings)";
+        }
+
+        std::cout << "\n";
+    }
+
+} /* namespace */
+
+toccata::RealtimeBenchmark::RealtimeBenchmark() {
+    m_name = "realtime";
+}
+
+toccata::RealtimeBenchmark::~RealtimeBenchmark() {
+    /* void */
+}
+
+void toccata::RealtimeBenchmark::Run() {
+    const int cpuCount = (int)std::thread::hardware_concurrency();
+
+    ThreadUtilities::RealtimeSettings off;
+
+    // CPU 0 is left to the OS and the producer if there are enough CPUs
+    ThreadUtilities::RealtimeSettings on;
+    on.Enabled = true;
+    on.Policy = ThreadUtilities::SchedulingPolicy::Fifo;
+    on.Priority = 10;
+    on.LockMemory = true;
+    if (cpuCount > ThreadCount + 1 && cpuCount <= 64) {
+        on.CpuMask = ((cpuCount == 64) ? ~0ull : ((1ull << cpuCount) - 1)) & ~1ull;
+    }
+
+    int offFailures = 0, onFailures = 0;
+    const LatencyHistogram offLatency = Measure(off, &offFailures);
+    const LatencyHistogram onLatency = Measure(on, &onFailures);
+
+    PrintDistribution("Real-time mode off", offLatency, offFailures);
+    PrintDistribution("Real-time mode on", onLatency, onFailures);
+}
+
+toccata::LatencyHistogram toccata::RealtimeBenchmark::Measure(
+    const ThreadUtilities::RealtimeSettings &settings, int *failures)
+{
+    constexpr int BarCount = 100;
+    constexpr double NoteInterval = 0.005;
+
+    Library library;
+
+    SongGenerator songGenerator;
+    songGenerator.Seed(0);
+    songGenerator.GenerateSong(&library, 4, 8);
+
+    MusicSegment inputSegment;
+    GenerateInput(&library, BarCount, 0, &inputSegment);
+
+    DecisionThread decisionThread;
+    decisionThread.Initialize(&library, ThreadCount, inputSegment.PulseUnit, 1.0);
+    decisionThread.SetRealtimeSettings(settings);
+    decisionThread.StartThreads();
+
+    LatencyHistogram latency;
+
+    const int n = inputSegment.NoteContainer.GetCount();
+    for (int i = 0; i < n; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+
+        while (!decisionThread.IsComplete()) {
+            std::this_thread::yield();
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+        latency.Record(std::chrono::duration<double>(end - start).count());
+
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(NoteInterval)));
+    }
+
+    *failures = decisionThread.GetRealtimeFailures();
+
+    decisionThread.KillThreads();
+    decisionThread.Destroy();
+
+    return latency;
+}
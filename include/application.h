@@ -8,6 +8,8 @@
 #include "music_segment.h"
 #include "midi_device_system.h"
 #include "decision_thread.h"
+#include "library_file.h"
+#include "residency_manager.h"
 #include "timeline.h"
 #include "practice_mode_panel.h"
 #include "current_time_display.h"
@@ -63,8 +65,11 @@ namespace toccata {
         PracticeModePanel m_practiceModePanel;
         CurrentTimeDisplay m_currentTimeDisplay;
 
+        LibraryFile m_libraryFile;
         Library m_library;
+        ResidencyManager m_residency;
         DecisionThread m_decisionThread;
+        long long m_snapshotVersion;
 
         Settings m_settings;
 
@@ -5,24 +5,62 @@
 #include "piece.h"
 
 #include <vector>
+#include <unordered_map>
 
 namespace toccata {
 
     class Bar {
     public:
+        // Routes with up to this many skips are precomputed so that FindNext
+        // doesn't have to search the successor graph
+        static constexpr int MaxCompiledSkips = 2;
+
         struct SearchResult {
             int Offset;
             double Distance;
         };
 
+        struct PitchCount {
+            unsigned short Pitch;
+            unsigned short Count;
+        };
+
+        // Features of the bar's notes that stay resident when the notes
+        // themselves don't, see Library::CompileSummaries
+        struct Summary {
+            bool Valid = false;
+
+            // Onset tatum estimate, zero if there was none
+            double Tatum = 0.0;
+            double TatumConfidence = 0.0;
+
+            // Sorted by pitch
+            std::vector<PitchCount> Pitches;
+        };
+
+    protected:
+        struct Route {
+            int Skips;
+
+            // Bars whose lengths add up to the route's distance. Lengths are
+            // read at lookup time since segments can be filled in after the
+            // bars are linked.
+            const Bar *Path[MaxCompiledSkips];
+        };
+
     public:
         Bar();
         ~Bar();
 
-        void AddNext(Bar *next);
+        // Loaders that link many bars at once can skip the update and call
+        // Library::CompileReachability when they are done
+        void AddNext(Bar *next, bool updateReachability = true);
         Bar *GetNext(int index) const;
         int GetNextCount() const { return (int)m_next.size(); }
 
+        Bar *GetPrevious(int index) const { return m_previous[index]; }
+        int GetPreviousCount() const { return (int)m_previous.size(); }
+
         void SetPiece(Piece *piece) { m_piece = piece; }
         Piece *GetPiece() const { return m_piece; }
 
@@ -35,13 +73,44 @@ namespace toccata {
         void SetIndex(int index) { m_index = index; }
         int GetIndex() const { return m_index; }
 
+        // Bars with identical content are grouped under the first one, see
+        // Library::CompileDuplicates. A bar is its own canonical bar until
+        // then.
+        void SetCanonical(Bar *canonical);
+        Bar *GetCanonical() const { return m_canonical; }
+        bool IsCanonical() const { return m_canonical == this; }
+
+        Bar *GetDuplicate(int index) const { return m_duplicates[index]; }
+        int GetDuplicateCount() const { return (int)m_duplicates.size(); }
+
+        void SetSummary(const Summary &summary) { m_summary = summary; }
+        const Summary &GetSummary() const { return m_summary; }
+
         SearchResult FindNext(const Bar *next, int skipsAllowed) const;
 
+        // Rebuilds the routes with exactly the given number of skips. Routes
+        // with one skip fewer must already be up to date in every successor.
+        void CompileReachability(int skips);
+
+    protected:
+        void UpdateReachability();
+
     protected:
         std::vector<Bar *> m_next;
+        std::vector<Bar *> m_previous;
+
+        // First route found by a depth-first search, indexed by skip count
+        std::unordered_map<const Bar *, Route> m_routes[MaxCompiledSkips + 1];
+
         MusicSegment *m_segment;
         Piece *m_piece;
 
+        // Other bars with the same content, only kept by the canonical bar
+        Bar *m_canonical;
+        std::vector<Bar *> m_duplicates;
+
+        Summary m_summary;
+
         int m_id;
         int m_index;
     };
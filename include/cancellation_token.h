@@ -0,0 +1,30 @@
+#ifndef TOCCATA_CORE_CANCELLATION_TOKEN_H
+#define TOCCATA_CORE_CANCELLATION_TOKEN_H
+
+#include <atomic>
+
+namespace toccata {
+
+    // Flag that asks long running work to stop at its next check. Any
+    // thread can cancel; the work decides where it is safe to stop.
+    class CancellationToken {
+    public:
+        CancellationToken() {
+            m_cancelled = false;
+        }
+
+        ~CancellationToken() {
+            /* void */
+        }
+
+        void Cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+        void Reset() { m_cancelled.store(false, std::memory_order_relaxed); }
+        bool IsCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    protected:
+        std::atomic<bool> m_cancelled;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_CANCELLATION_TOKEN_H */
@@ -5,7 +5,7 @@
 #include "transform.h"
 
 #include <random>
-#include <set>
+#include <vector>
 
 namespace toccata {
 
@@ -23,7 +23,7 @@ namespace toccata {
             int MappedNotes;
             int MappingStart;
             int MappingEnd;
-            std::set<int> *Target = nullptr;
+            std::vector<int> *Target = nullptr;
         };
 
         static bool CalculateError(
@@ -4,8 +4,15 @@
 #include "decision_tree.h"
 
 #include "music_segment.h"
+#include "spsc_ring.h"
+#include "snapshot_publisher.h"
+#include "dirty_range_queue.h"
+#include "cancellation_token.h"
+#include "latency_histogram.h"
 
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <atomic>
 #include <thread>
 #include <vector>
@@ -13,7 +20,69 @@
 namespace toccata {
 
     class DecisionThread {
+    protected:
+        // Maximum number of iterations between snapshots while the tree is
+        // still catching up with the input
+        static constexpr int SnapshotPublishInterval = 16;
+
+        // Minimum number of notes retired at once so that the cost of
+        // rebasing the tree is spread over many notes
+        static constexpr int HorizonBatch = 64;
+
+        // Time spent polling for new notes before the thread parks
+        static constexpr double DefaultSpinWindow = 0.0005;
+
+        // Number of notes that can be waiting to be picked up by the thread
+        static constexpr int InputRingCapacity = 4096;
+
+        // Maximum number of start indices matched in the same pass
+        static constexpr int PipelineDepth = 4;
+
+        static constexpr double DefaultTargetLatency = 0.005;
+
     public:
+        enum class Stage {
+            Ingest,
+            Match,
+            Integrate,
+            Publish
+        };
+
+        static constexpr int StageCount = 4;
+
+        // Completed note as it travels from MIDI input to the thread
+        struct NoteEvent {
+            timestamp Timestamp;
+            unsigned short Pitch;
+            unsigned short Length;
+            unsigned short Velocity;
+        };
+
+        // Results as seen by readers. Peak metrics cover every iteration
+        // since the metrics in an earlier snapshot were read.
+        struct Snapshot {
+            long long Version = 0;
+            std::vector<DecisionTree::MatchedPiece> Pieces;
+
+            int PeakIndex = 0;
+            int PeakTargetIndex = 0;
+            double PeakLatency = 0.0;
+            double PeakWakeLatency = 0.0;
+            int PeakActiveWorkers = 0;
+            LatencyHistogram StageLatency[StageCount];
+
+            // Totals since the thread was started
+            double MatchCacheHitRate = 0.0;
+            double SavedSolveTime = 0.0;
+        };
+
+        // Notes and pieces that fell behind the horizon. Note indices are
+        // relative to the start of the session.
+        struct Archive {
+            std::vector<MusicPoint> Notes;
+            std::vector<DecisionTree::MatchedPiece> Pieces;
+        };
+
         DecisionThread();
         ~DecisionThread();
 
@@ -25,14 +94,66 @@ namespace toccata {
         void DoIteration();
         void RunThread();
 
-        void AddNote(const MusicPoint &point);
+        void SetSpinWindow(double spinWindow) { m_spinWindow = spinWindow; }
+        double GetSpinWindow() const { return m_spinWindow; }
+
+        // Bounds on the number of workers matching in parallel. Between
+        // the bounds, workers are added while the time to catch up with the
+        // input exceeds the target latency and parked again once it is
+        // comfortably below it or the input has been caught up with. The
+        // maximum is capped at the thread count given to Initialize.
+        void SetWorkerLimits(int minimum, int maximum);
+        int GetMinimumWorkers() const { return m_minimumWorkers; }
+        int GetMaximumWorkers() const { return m_maximumWorkers; }
+
+        void SetTargetLatency(double latency) { m_targetLatency = latency; }
+        double GetTargetLatency() const { return m_targetLatency; }
+
+        // Affinity, scheduling and memory locking for the coordinator and
+        // the workers. Must be set before StartThreads. Anything the
+        // platform refuses is counted and otherwise ignored.
+        void SetRealtimeSettings(const ThreadUtilities::RealtimeSettings &settings) { m_tree.SetRealtimeSettings(settings); }
+        const ThreadUtilities::RealtimeSettings &GetRealtimeSettings() const { return m_tree.GetRealtimeSettings(); }
+        int GetRealtimeFailures() const { return m_realtimeFailures + m_tree.GetRealtimeFailures(); }
 
-        bool IsComplete() { return m_complete; }
+        // Time in seconds an iteration may spend matching before it stops
+        // and publishes what it found so far. The rest of the pass resumes
+        // on the next iteration. Zero finishes a start index every
+        // iteration regardless of how long it takes.
+        void SetIterationBudget(double budget) { m_iterationBudget = budget; }
+        double GetIterationBudget() const { return m_iterationBudget; }
+
+        // Queues a note without blocking. Only one thread may add notes at
+        // a time. Returns false if the input ring is full and the note was
+        // dropped. Cancels the pass in flight if the note lands inside the
+        // window it is matching.
+        bool AddNote(const MusicPoint &point);
+
+        // The ring is checked first. A note that has already been taken off
+        // the ring has cleared the flag by then.
+        bool IsComplete() { return m_input.IsEmpty() && m_complete; }
+
+        // True while the thread is blocked waiting for input, no iterations
+        // run until it's woken up
+        bool IsParked() const { return m_parked; }
+        long long GetIterationCount() const { return m_iterations; }
 
         DecisionTree *GetTree() { return &m_tree; }
 
+        // Input older than the given number of bars behind the newest piece
+        // or seconds behind the newest note is retired. A value of zero
+        // disables that limit. If both are set, notes are only retired once
+        // they are past both.
+        void SetHorizon(int bars, double seconds);
+
+        int GetIndexOffset();
+        void ReadArchive(Archive *target);
+
         void Clear();
+
+        // Reads from the latest snapshot and never wait on the solver
         std::vector<DecisionTree::MatchedPiece> GetPieces();
+        long long GetSnapshotVersion();
 
         void RecordIndex(int index);
         int ReadPeakIndex();
@@ -43,19 +164,93 @@ namespace toccata {
         void RecordLatency(double latency);
         double ReadPeakLatency();
 
+        void RecordWakeLatency(double latency);
+        double ReadPeakWakeLatency();
+
+        // Time spent in each stage of an iteration. Ingest is only recorded
+        // for iterations that picked up new notes.
+        void RecordStageLatency(Stage stage, std::chrono::steady_clock::time_point start);
+        LatencyHistogram ReadStageLatency(Stage stage);
+
+        void RecordActiveWorkers(int workers);
+        int ReadPeakActiveWorkers();
+
+        double ReadMatchCacheHitRate();
+        double ReadSavedSolveTime();
+
+        // Percentage of time spent parked since the last read
+        double ReadIdlePercentage();
+
+    protected:
+        // Returns true if any notes were picked up
+        bool DrainInput();
+
+        // Lowest start index that hasn't been processed yet
+        int GetPendingIndex() const;
+
+        // Matches the pending pass, or a new one at the lowest dirty
+        // indices, until the iteration budget runs out. Returns true if
+        // there are results to integrate.
+        bool Match(std::chrono::steady_clock::time_point start);
+        void PublishSnapshot();
+        void UpdateWorkerCount(double latency, bool caughtUp);
+        void WaitForWork();
+        void ApplyHorizon();
+        void ArchivePieces(int cutoff);
+
     protected:
         std::mutex m_bufferLock;
 
+        // Only taken to park the thread and to wake it up
+        std::mutex m_parkLock;
+        std::condition_variable m_workAvailable;
+
+        SnapshotPublisher<Snapshot> m_snapshots;
+        long long m_snapshotVersion;
+        std::atomic<long long> m_metricsReadVersion;
+        int m_iterationsSincePublish;
+
     protected:
+        SpscRing<NoteEvent, InputRingCapacity> m_input;
         MusicSegment m_inputBuffer;
 
-        int m_currentIndex;
+        // Start indices that still have to be processed
+        DirtyRangeQueue m_dirty;
         std::atomic<bool> m_complete;
         std::atomic<bool> m_kill;
         std::thread m_thread;
 
+        double m_spinWindow;
+        double m_iterationBudget;
+
+        int m_threadCount;
+        int m_minimumWorkers;
+        int m_maximumWorkers;
+        int m_activeWorkers;
+        double m_targetLatency;
+        std::atomic<int> m_realtimeFailures;
+        std::atomic<bool> m_parked;
+        std::atomic<long long> m_iterations;
+
+        // Time the newest note was added, in steady clock ticks
+        std::atomic<long long> m_workAdded;
+
+        // Timestamps bounding the window of the pass in flight. A note
+        // after the first and not after the last invalidates the pass.
+        CancellationToken m_cancel;
+        std::atomic<bool> m_inFlight;
+        std::atomic<timestamp> m_inFlightStart;
+        std::atomic<timestamp> m_inFlightEnd;
+
         DecisionTree m_tree;
 
+        int m_horizonBars;
+        double m_horizonSeconds;
+
+        // Number of notes retired so far
+        int m_indexOffset;
+        Archive m_archive;
+
     protected:
         // Metrics
         bool m_peakIndexReset;
@@ -66,6 +261,19 @@ namespace toccata {
 
         bool m_peakLatencyReset;
         double m_peakLatency;
+
+        bool m_peakWakeLatencyReset;
+        double m_peakWakeLatency;
+
+        bool m_peakActiveWorkersReset;
+        int m_peakActiveWorkers;
+
+        bool m_stageLatencyReset;
+        LatencyHistogram m_stageLatency[StageCount];
+
+        double m_idleTime;
+        std::chrono::steady_clock::time_point m_idleStart;
+        std::chrono::steady_clock::time_point m_idleWindowStart;
     };
 
 } /* namespace toccata */
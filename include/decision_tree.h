@@ -6,13 +6,22 @@
 #include "full_solver.h"
 #include "bar.h"
 #include "transform.h"
+#include "object_pool.h"
+#include "inline_vector.h"
+#include "match_cache.h"
+#include "cancellation_token.h"
+#include "thread_utilities.h"
+#include "tempo_tracker.h"
+#include "tempo_estimator.h"
+#include "residency_manager.h"
 
 #include <vector>
-#include <queue>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <set>
+#include <atomic>
 
 namespace toccata {
 
@@ -21,7 +30,56 @@ namespace toccata {
         static constexpr double DefaultMargin = 0.25;
         static constexpr bool ForceMultithreaded = false;
 
+        // Number of maximum decision footprints to look back when searching
+        // for a parent decision
+        static constexpr int ParentSearchFootprints = 3;
+
+        // Number of matches in a row that can be found by re-verifying an
+        // existing decision before a full solve is forced
+        static constexpr int ReverificationRefreshInterval = 16;
+
+        // Score following. A piece is locked once a branch of this many
+        // bars ends near the start index. Locked passes only match bars up
+        // to the lookahead number of successors past the bars just
+        // matched, and every n-th pass still searches the whole library so
+        // that a change of piece is noticed.
+        static constexpr int DefaultFollowerLockDepth = 4;
+        static constexpr int DefaultFollowerLookahead = 2;
+        static constexpr int DefaultFollowerCheckInterval = 32;
+
+        // Tempo prediction. A bar is predicted from a decision for one of
+        // its predecessors that ends at most this many notes before the
+        // start index. Predictions are trusted within this many standard
+        // deviations and never bound the scale tighter than the tolerance.
+        static constexpr int PredecessorSearchNotes = 4;
+        static constexpr double PredictionSigmas = 3.0;
+        static constexpr double MinimumScaleTolerance = 0.1;
+
+        // Tempo prior. The input tatum is estimated from this many notes
+        // on either side of a pass's start indices, and a tatum is only
+        // used if it explains at least this fraction of the intervals.
+        static constexpr int TatumEstimateNotes = 32;
+        static constexpr double MinimumTatumConfidence = 0.6;
+
+        // The prior prunes transforms so cached results depend on the input
+        // tatum. It's part of the cache key at this resolution (a fraction
+        // of the tempo tolerance) so that small drifts between passes still
+        // hit.
+        static constexpr double CacheTatumResolution = 0.01;
+
+        // Largest fraction of a bar's notes a match can leave unmapped
+        static constexpr double MissingNoteThreshold = 0.25;
+
+        static constexpr int InlineChildren = 4;
+        static constexpr int InlineOverlaps = 8;
+
     public:
+        enum class PassStatus {
+            Complete,
+            Partial,
+            Cancelled
+        };
+
         struct MatchedBar {
             const Bar *MatchedBar;
 
@@ -43,30 +101,48 @@ namespace toccata {
         };
 
         struct Decision {
+            ObjectHandle Handle;
+
             const Bar *MatchedBar;
 
             int Index;
+            int Sequence;
 
-            std::set<int> Notes;
+            std::vector<int> Notes; // Sorted
             int MappedNotes;
 
+            // Input range the match depended on. The end isn't clamped, so
+            // a window cut short by the end of the input also covers notes
+            // that haven't arrived yet.
+            int WindowStart;
+            int WindowEnd;
+
             bool Cached = false;
             int Depth;
-            Decision *ParentDecision;
+            ObjectHandle ParentDecision;
 
-            std::vector<Decision *> OverlappingDecisions;
+            // Totals over the branch ending at this decision, valid while
+            // the decision is cached
+            int BranchNoteCount;
+            int BranchStart;
+            int BranchEnd;
+            TempoTracker Tempo;
+
+            InlineVector<ObjectHandle, InlineChildren> Children;
+            InlineVector<ObjectHandle, InlineOverlaps> OverlappingDecisions;
 
             bool Singular;
             Transform T;
 
+            // Number of times in a row T was carried over from a nearby
+            // match by re-verification instead of being solved for
+            int ReverifiedStreak = 0;
+
             double AverageError;
 
             bool IsSameAs(const Decision *decision) const;
             bool IsBetterFitThan(const Decision *decision) const;
 
-            bool IsCached() const;
-            void InvalidateCache();
-
             int GetFootprint() const;
             int GetEnd() const;
             int GetStart() const;
@@ -81,10 +157,84 @@ namespace toccata {
             Decision *ParentDecision;
             Decision *StartDecision;
             Decision *EndDecision;
-            bool Filtered;
+
+            int GetLength() const { return End - Start + 1; }
+        };
+
+        struct AllocationStatistics {
+            long long DecisionAllocations;
+            long long SlabAllocations;
+            int LiveDecisions;
+            int PoolCapacity;
+        };
+
+        struct SolverStatistics {
+            long long FullSolves;
+
+            // Matches found by re-verifying an existing decision, each of
+            // which would otherwise have needed a full solve
+            long long Reverified;
+            long long ReverificationAttempts;
+
+            // Full solves forced because every transform that could have
+            // been re-verified had been carried over too many times
+            long long ReverificationRefreshes;
+
+            // Passes abandoned because their start index went stale
+            long long CancelledPasses;
+
+            // Passes that only matched the successors of a locked piece
+            long long FollowedPasses;
+
+            // Matches attempted with a predicted transform and window, and
+            // the ones that needed no wide search
+            long long PredictionAttempts;
+            long long Predicted;
+
+            // Hypotheses evaluated by full solves
+            long long EvaluatedHypotheses;
+
+            // Matches copied from a canonical bar to its duplicates
+            long long SharedMatches;
+
+            // Bars skipped because the window doesn't have enough notes of
+            // their pitches
+            long long Prefiltered;
+        };
+
+        struct QueryStatistics {
+            // Lookups in the decision index and the decisions they visited
+            long long Queries;
+            long long VisitedDecisions;
+        };
+
+        struct MatchCacheStatistics {
+            long long Hits;
+            long long Misses;
+
+            // Total time spent solving on misses and the estimated time the
+            // hits would have taken
+            double SolveTime;
+            double SavedTime;
+
+            // Bars that currently have a table
+            int Tables;
+
+            double GetHitRate() const {
+                return (Hits + Misses > 0)
+                    ? Hits / (double)(Hits + Misses)
+                    : 0.0;
+            }
         };
 
     protected:
+        struct MergeEntry {
+            int StartIndex;
+            int BarIndex;
+            Decision *Candidate;
+            Decision *Same;
+        };
+
         struct ThreadContext {
             std::thread *Thread;
 
@@ -97,25 +247,64 @@ namespace toccata {
             bool Done = false;
             bool Kill = false;
 
-            int LibraryStart = 0;
-            int LibraryEnd = 0;
+            // Next (start index, bar) task for this worker. Tasks are laid
+            // out by bar priority first and start index second, and workers
+            // take every n-th task so that each slice covers the highest
+            // priority bars of every start index first.
+            int TaskCursor = 0;
+            std::chrono::steady_clock::time_point Deadline;
 
             int DecisionStart = 0;
             int DecisionEnd = 0;
 
-            int StartIndex = 0;
+            const CancellationToken *Token = nullptr;
+
+            // Decisions found during the last pass. Entries are reused
+            // between passes so that matching doesn't allocate.
+            std::vector<Decision> Candidates;
+            int CandidateCount = 0;
+
+            // Existing decision for the same bar that each candidate would
+            // replace, or nullptr if the candidate is new. Found by the
+            // worker so that only the merge runs on the calling thread.
+            std::vector<Decision *> SameDecisions;
+            std::vector<Decision *> Overlapping;
+
+            // Existing decisions considered for re-verification, and
+            // scratch notes for all but the best fit among them
+            std::vector<Decision *> Nearby;
+            std::vector<int> ReverifiedNotes;
+
+            // Decisions considered for predicting a bar's tempo
+            std::vector<Decision *> Predecessors;
+            long long PredictionAttempts = 0;
+            long long Predicted = 0;
+
+            long long SharedMatches = 0;
+            long long Prefiltered = 0;
 
-            std::queue<Decision *> NewDecisions;
+            long long FullSolves = 0;
+            long long Reverified = 0;
+            long long ReverificationAttempts = 0;
+            long long ReverificationRefreshes = 0;
+
+            long long CacheHits = 0;
+            long long CacheMisses = 0;
+            double SolveTime = 0.0;
+
+            // Scratch entry for copying results in and out of the match
+            // cache, reused so that hits don't allocate
+            MatchCache::Entry CacheEntry;
         };
 
     public:
         DecisionTree();
         ~DecisionTree();
 
-        void SetMargin(double margin) { m_margin = margin; }
+        void SetMargin(double margin) { m_margin = margin; m_maxWindowBarCount = 0; }
         double GetMargin() const { return m_margin; }
 
-        void SetLibrary(Library *library) { m_library = library; }
+        void SetLibrary(Library *library) { m_library = library; m_maxWindowBarCount = 0; }
         Library *GetLibrary() const { return m_library; }
 
         void SetInputSegment(const MusicSegment *segment) { m_segment = segment; }
@@ -124,26 +313,185 @@ namespace toccata {
         Decision *GetDecision(int index) { return m_decisions[index]; }
         int GetDecisionCount() const { return (int)m_decisions.size(); }
 
+        Decision *GetParent(const Decision *decision) const {
+            return m_decisionPool.Resolve(decision->ParentDecision);
+        }
+
+        AllocationStatistics GetAllocationStatistics() const;
+        QueryStatistics GetQueryStatistics() const;
+        MatchCacheStatistics GetMatchCacheStatistics() const;
+        SolverStatistics GetSolverStatistics() const;
+
+        void SetMatchCacheEnabled(bool enabled) { m_matchCacheEnabled = enabled; }
+        bool IsMatchCacheEnabled() const { return m_matchCacheEnabled; }
+
+        // Largest number of bars the match cache keeps results for. Bars
+        // whose piece is evicted by the residency manager are dropped too.
+        void SetMatchCacheLimit(int tables) { m_matchCache.SetTableLimit(tables); }
+        int GetMatchCacheLimit() const { return m_matchCache.GetTableLimit(); }
+
+        void SetReverificationEnabled(bool enabled) { m_reverificationEnabled = enabled; }
+        bool IsReverificationEnabled() const { return m_reverificationEnabled; }
+
+        // Predicts each bar's transform from the tempo of the branch that
+        // leads into it and searches a narrower window and scale range
+        // first. The wide search is the fallback.
+        void SetTempoTrackingEnabled(bool enabled) { m_tempoTrackingEnabled = enabled; }
+        bool IsTempoTrackingEnabled() const { return m_tempoTrackingEnabled; }
+
+        // Rejects solver hypotheses whose scale doesn't relate the onset
+        // tatum of the bar to that of the input by a small whole ratio
+        void SetTempoPriorEnabled(bool enabled) { m_tempoPriorEnabled = enabled; }
+        bool IsTempoPriorEnabled() const { return m_tempoPriorEnabled; }
+
+        // Matches only the canonical bar of each group of identical bars
+        // and copies the result to the rest of the group. Groups come from
+        // Library::CompileDuplicates.
+        void SetDeduplicationEnabled(bool enabled) { m_deduplicationEnabled = enabled; }
+        bool IsDeduplicationEnabled() const { return m_deduplicationEnabled; }
+
+        // Skips bars whose summary shows that too few of their notes could
+        // be mapped to the window. Bars without a summary are always
+        // matched, see Library::CompileSummaries.
+        void SetPrefilterEnabled(bool enabled) { m_prefilterEnabled = enabled; }
+        bool IsPrefilterEnabled() const { return m_prefilterEnabled; }
+
+        // Bars are touched before their notes are read and the pieces that
+        // follow recent matches are prefetched. Not owned.
+        void SetResidency(ResidencyManager *residency) { m_residency = residency; }
+        ResidencyManager *GetResidency() const { return m_residency; }
+
+        // Estimated around the last pass that began, zero if the onsets
+        // were too irregular
+        double GetInputTatum() const { return m_inputTatum; }
+
+        void SetFollowerEnabled(bool enabled) { m_followerEnabled = enabled; }
+        bool IsFollowerEnabled() const { return m_followerEnabled; }
+
+        void SetFollowerParameters(int lockDepth, int lookahead, int checkInterval);
+        int GetFollowerLockDepth() const { return m_followerLockDepth; }
+        int GetFollowerLookahead() const { return m_followerLookahead; }
+        int GetFollowerCheckInterval() const { return m_followerCheckInterval; }
+
+        // True if the last pass that began only matched a locked piece
+        bool IsFollowing() const { return m_following; }
+
         void InvalidateAfter(int index);
+
+        // Removes the decisions whose window contains a note that changed
+        // in place
         void OnNoteChange(int changedNote);
 
+        // Removes the decisions whose window the inserted note falls into
+        // and moves every later decision along with the input
+        void OnNoteInserted(int index);
+
+        // Lowest start index whose match can depend on the given note
+        int GetFirstDependentStart(int index) const;
+
+        // Highest note index the match at the given start index can depend
+        // on. May lie past the end of the input.
+        int GetLastDependentIndex(int startIndex) const;
+
+        // Largest note index not above the limit that no decision straddles
+        int FindSafeCutoff(int limit) const;
+
+        // Removes every decision that ends before the cutoff and shifts the
+        // remaining note indices down so that the cutoff becomes index 0
+        void Retire(int cutoff);
+
         void Initialize(int threadCount);
+
+        // Number of workers that take part in passes, between one and the
+        // thread count the tree was initialized with. Takes effect when the
+        // next pass begins. Workers left out stay parked.
+        void SetActiveThreadCount(int count);
+        int GetActiveThreadCount() const { return m_activeThreadCount; }
+
+        // Applied by each worker when it starts, so it has to be set before
+        // SpawnThreads. Solver memory is locked by SpawnThreads.
+        void SetRealtimeSettings(const ThreadUtilities::RealtimeSettings &settings) { m_realtimeSettings = settings; }
+        const ThreadUtilities::RealtimeSettings &GetRealtimeSettings() const { return m_realtimeSettings; }
+
+        // Number of workers and solvers that couldn't get the requested
+        // real-time settings, usually for lack of permissions. They carry
+        // on with the default ones.
+        int GetRealtimeFailures() const { return m_realtimeFailures; }
+
         void SpawnThreads();
         void KillThreads();
         void Destroy();
-        void Process(int startIndex);
 
-        int GetDepth(Decision *decision) const;
-        int GetBranchNoteCount(Decision *decision) const;
-        double GetBranchAverageError(Decision *decision) const;
-        int GetBranchStart(Decision *decision) const;
+        // Matches every library bar at the given start index. Returns false
+        // without changing any decisions if the token was cancelled before
+        // the pass finished.
+        bool Process(int startIndex, const CancellationToken *token = nullptr);
+
+        // Starts a pass that can be spread over several calls to
+        // ContinuePass. Bars are matched in order of how likely they are to
+        // match: successors of the bars that just ended, bars matched
+        // nearby, the rest of their pieces and then everything else.
+        void BeginPass(int startIndex) { BeginPass(&startIndex, 1); }
+
+        // Starts a pass over several start indices, given in ascending
+        // order, so that a backlog is matched in parallel. Decisions are
+        // merged in start index order.
+        void BeginPass(const int *startIndices, int count);
+
+        // Matches bars until the deadline passes and merges the decisions
+        // found so far. Every worker matches at least one bar per call, so
+        // a call overruns the deadline by at most one match. A cancelled
+        // pass is abandoned and the current slice is discarded.
+        PassStatus ContinuePass(
+            std::chrono::steady_clock::time_point deadline,
+            const CancellationToken *token = nullptr);
+
+        // The two halves of ContinuePass. MatchSlice fans the bar tasks out
+        // to the workers and returns false if the pass was cancelled.
+        // IntegrateSlice merges what the workers found.
+        bool MatchSlice(
+            std::chrono::steady_clock::time_point deadline,
+            const CancellationToken *token = nullptr);
+        PassStatus IntegrateSlice();
+
+        void AbandonPass() { m_passPending = false; }
+        bool IsPassPending() const { return m_passPending; }
+
+        // Start indices of the pending pass. Indices whose window changed
+        // while the pass was pending are dropped and set to -1.
+        const std::vector<int> &GetPassStartIndices() const { return m_passStartIndices; }
+        int GetPassStartIndex() const;
+        int GetLastPassStartIndex() const;
+
+        int GetDepth(Decision *decision);
+        int GetBranchNoteCount(Decision *decision);
+        double GetBranchAverageError(Decision *decision);
+        int GetBranchStart(Decision *decision);
         int GetBranchEnd(Decision *decision);
 
+        bool IsCached(const Decision *decision) const { return decision->Cached; }
+        void InvalidateCache(Decision *decision);
+
         void Clear();
         std::vector<MatchedPiece> GetPieces();
+        bool IsPieceListDirty() const { return m_piecesDirty; }
 
     protected:
         void DistributeWork();
+        void PrioritizeBars(int startIndex, std::vector<int> *order);
+        void CanonicalizeBars(std::vector<int> *order);
+        void UpdateWindowPitches();
+        bool MayMatch(const Bar *bar, int slot) const;
+        void PrefetchSuccessors();
+        void ShareMatch(const Bar *bar, ThreadContext &context);
+        bool IsReachable(const Bar *from, const Bar *reference) const;
+        void UpdateTatums();
+
+        // Orders only the bars within the lookahead of a locked piece.
+        // Returns false if no piece is locked around the start index.
+        bool FollowBars(int startIndex, std::vector<int> *order);
+        void UpdatePassPending();
+        bool IsRunningInline() const;
         void TriggerThreads();
         void WaitForThreads();
         void Integrate();
@@ -153,33 +501,144 @@ namespace toccata {
         void UpdateOverlapMatrix(Decision *decision);
         void CleanOverlapMatrix(Decision *decision);
 
-        Decision *FindBestParent(const Decision *decision) const;
+        void FindDependents(int index, bool inserted, std::vector<Decision *> *target) const;
+        void RemoveDecisions(const std::vector<Decision *> &decisions);
+        void ShiftDecisions(int index);
 
-        bool IntegrateDecision(Decision *decision);
+        void UpdateBranches();
+        void UpdateBranch(Decision *decision);
+        Decision *FindBestParent(const Decision *decision);
 
-        Decision *AllocateDecision() const { return new Decision; }
-        void DestroyDecision(Decision *decision) { delete decision; }
+        void ResolveCandidates(ThreadContext &context) const;
+        Decision *FindSameDecision(const Decision *candidate, std::vector<Decision *> *scratch) const;
+        Decision *InsertDecision(const Decision *candidate);
+
+        void AddToIndex(Decision *decision);
+        void RemoveFromIndex(Decision *decision);
+        void FindDecisions(int endMin, int endMax, std::vector<Decision *> *target) const;
+        void FindOverlapping(const Decision *decision, std::vector<Decision *> *target) const;
+
+        Decision *AllocateDecision();
+        void DestroyDecision(Decision *decision);
+
+        static void CopyMatch(Decision *target, const Decision *source);
 
         void WorkerThread(int threadId);
         void Work(int threadId, ThreadContext &context);
-        void SeedMatch(
-            int libraryStart, int libraryEnd,
-            int threadId);
-        Decision *Match(const Bar *bar, int startIndex, ThreadContext &context);
-
-        static void TrimPiece(int index, std::vector<PieceData> &pieceData, int startTrim, int endTrim);
+        void SeedMatch(int threadId);
+        void TrimMatchCache();
+        bool CachedMatch(int barIndex, int startIndex, ThreadContext &context, Decision *target);
+        bool Match(const Bar *bar, int startIndex, ThreadContext &context, Decision *target);
+        bool Reverify(
+            const Bar *bar, const FullSolver::Request &request, ThreadContext &context,
+            FullSolver::Result *result, int *streak);
+
+        // Narrows the request to the window and scale range that the tempo
+        // of a preceding branch predicts. Returns false if there is no
+        // such branch or the window doesn't start where it predicts.
+        bool Predict(const Bar *bar, ThreadContext &context, FullSolver::Request *request, Transform *T) const;
+        int GetWindowEnd(const Bar *bar, int startIndex) const;
+        int GetWindowLength(const Bar *bar) const;
+        int GetMaxWindowLength() const;
+
+        void UpdatePieces();
+        void TrimPiece(const PieceData &piece, int startTrim, int endTrim, std::vector<PieceData> *fragments) const;
+        void AddFragment(Decision *parent, Decision *start, Decision *end, std::vector<PieceData> *fragments) const;
+        MatchedPiece ConstructPiece(const PieceData &data) const;
 
     protected:
+        ObjectPool<Decision> m_decisionPool;
         std::vector<Decision *> m_decisions;
 
+        // Decisions sorted by the index of their last note
+        std::set<std::pair<int, Decision *>> m_endIndex;
+
+        // Workers query the index as well
+        mutable std::atomic<long long> m_decisionQueries;
+        mutable std::atomic<long long> m_visitedDecisions;
+        int m_maxFootprint;
+        int m_nextSequence;
+
+        // Every decision that isn't cached ends at or after this index
+        int m_firstInvalidEnd;
+        std::vector<Decision *> m_invalidationStack;
+
+        // Pieces are rebuilt only after the decision set has changed
+        std::vector<MatchedPiece> m_pieces;
+        bool m_piecesDirty;
+
+        // Solver results by bar and window content
+        MatchCache m_matchCache;
+        bool m_matchCacheEnabled;
+        std::vector<int> m_evictedBars;
+        bool m_reverificationEnabled;
+        bool m_tempoTrackingEnabled;
+        bool m_deduplicationEnabled;
+
+        // Pitch counts of the widest window at each pass start index, by
+        // slot
+        bool m_prefilterEnabled;
+        std::vector<int> m_windowPitches;
+
+        ResidencyManager *m_residency;
+
+        // Onset tatums of the library bars by id and of the input around
+        // the pending pass
+        bool m_tempoPriorEnabled;
+        TempoEstimator m_tempoEstimator;
+        std::vector<double> m_barTatums;
+        double m_inputTatum;
+
+        // Number of notes retired so far, keeps cache positions stable
+        int m_retiredNotes;
+
+        long long m_cancelledPasses;
+
+        // Pass in progress and the order its bars are matched in for each
+        // start index
+        bool m_passPending;
+        int m_passTaskCount;
+        std::vector<int> m_passStartIndices;
+        std::vector<std::vector<int>> m_barOrders;
+        std::vector<bool> m_barQueued;
+        std::vector<Decision *> m_recentDecisions;
+        std::vector<const Piece *> m_recentPieces;
+        std::vector<const Bar *> m_followFrontier;
+
+        bool m_followerEnabled;
+        bool m_following;
+        int m_followerLockDepth;
+        int m_followerLookahead;
+        int m_followerCheckInterval;
+        int m_passesSinceFullSearch;
+        long long m_followedPasses;
+
+        // Candidates of the last slice in the order they are merged
+        std::vector<MergeEntry> m_mergeOrder;
+        std::vector<bool> m_barMerged;
+        std::vector<Decision *> m_mergeScratch;
+
+        // Candidate parents of the decision whose branch is being updated
+        std::vector<Decision *> m_parentCandidates;
+
         ThreadContext *m_threadContexts;
 
         Library *m_library;
         const MusicSegment *m_segment;
 
         int m_threadCount;
+        int m_activeThreadCount;
+        int m_requestedThreadCount;
+
+        ThreadUtilities::RealtimeSettings m_realtimeSettings;
+        std::atomic<int> m_realtimeFailures;
 
         double m_margin = DefaultMargin;
+
+        // Longest window of the bars checked so far. Only read on the
+        // calling thread.
+        mutable int m_maxWindowLength = 1;
+        mutable int m_maxWindowBarCount = 0;
     };
 
 } /* namespace toccata */
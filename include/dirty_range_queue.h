@@ -0,0 +1,41 @@
+#ifndef TOCCATA_CORE_DIRTY_RANGE_QUEUE_H
+#define TOCCATA_CORE_DIRTY_RANGE_QUEUE_H
+
+#include <map>
+
+namespace toccata {
+
+    // Set of indices waiting to be processed, stored as disjoint ranges and
+    // handed out lowest index first
+    class DirtyRangeQueue {
+    public:
+        DirtyRangeQueue();
+        ~DirtyRangeQueue();
+
+        // Marks every index from start to end (inclusive) as dirty
+        void Add(int start, int end);
+
+        // Moves every dirty index at or after the given index up by one to
+        // make room for an inserted element
+        void Insert(int index);
+
+        // Drops every index below the count and moves the rest down by it
+        void Remove(int count);
+
+        int Pop();
+        int GetFirst() const;
+
+        bool IsEmpty() const { return m_ranges.empty(); }
+        int GetSize() const { return m_size; }
+
+        void Clear();
+
+    protected:
+        // Range start -> range end
+        std::map<int, int> m_ranges;
+        int m_size;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_DIRTY_RANGE_QUEUE_H */
@@ -6,6 +6,8 @@
 #include "comparator.h"
 #include "transform.h"
 
+#include <cfloat>
+
 namespace toccata {
 
     class FullSolver {
@@ -28,6 +30,14 @@ namespace toccata {
 
             int StartIndex = -1;
             int EndIndex = -1;
+
+            // Bounds on the scale of the transform searched for
+            double MinScale = 0.0;
+            double MaxScale = DBL_MAX;
+
+            // Onset tatums of the reference and the input, zero if unknown
+            double ReferenceTatum = 0.0;
+            double InputTatum = 0.0;
         };
 
         struct Result {
@@ -43,17 +53,35 @@ namespace toccata {
         void Initialize();
         void Release();
 
+        // Pre-faults the solver's buffers and keeps them resident. Returns
+        // false if the platform refused to lock any of them.
+        bool LockMemory();
+
         bool Solve(const Request &request, Result *result);
 
+        // Checks whether a known transform still explains the window using
+        // a nearest-neighbour mapping instead of a full search. Returns
+        // false if the mapping isn't one-to-one or misses too many notes.
+        bool Verify(const Request &request, const Transform &T, Result *result);
+
+        // Hypotheses evaluated by all calls to Solve so far
+        long long GetEvaluatedHypotheses() const { return m_evaluatedHypotheses; }
+
+    protected:
+        bool Refine(const Request &request, const int *mapping, const Transform &coarse, Result *result);
+
     protected:
         TestPatternGenerator m_testPatternGenerator;
         TestPatternEvaluator::Request::MemorySpace m_memorySpace;
         int **m_notesByPitchBuffer;
         int *m_testPatternBuffer;
+        bool *m_mappedBuffer;
 
     protected:
         int m_testPatternLength = DefaultTestPatternLength;
         double m_missingNoteThreshold = DefaultMissingNoteThreshold;
+
+        long long m_evaluatedHypotheses = 0;
     };
 
 } /* namespace toccata */
@@ -0,0 +1,113 @@
+#ifndef TOCCATA_CORE_INLINE_VECTOR_H
+#define TOCCATA_CORE_INLINE_VECTOR_H
+
+#include <assert.h>
+#include <vector>
+
+namespace toccata {
+
+    // Vector that stores up to T_InlineCapacity elements without touching
+    // the heap. Only intended for small, trivially copyable elements.
+    template <typename T_Element, int T_InlineCapacity>
+    class InlineVector {
+    public:
+        InlineVector() {
+            m_size = 0;
+            m_spilled = false;
+        }
+
+        InlineVector(const InlineVector &v) {
+            m_size = 0;
+            m_spilled = false;
+
+            *this = v;
+        }
+
+        ~InlineVector() {
+            /* void */
+        }
+
+        InlineVector &operator=(const InlineVector &v) {
+            if (this == &v) return *this;
+
+            Clear();
+            for (const T_Element &element : v) {
+                Add(element);
+            }
+
+            return *this;
+        }
+
+        void Add(const T_Element &element) {
+            if (!m_spilled && m_size == T_InlineCapacity) {
+                m_overflow.assign(m_inline, m_inline + m_size);
+                m_spilled = true;
+            }
+
+            if (m_spilled) m_overflow.push_back(element);
+            else m_inline[m_size] = element;
+
+            ++m_size;
+        }
+
+        void Remove(T_Element *element) {
+            assert(element >= begin() && element < end());
+
+            T_Element *last = end() - 1;
+            for (T_Element *i = element; i != last; ++i) {
+                *i = *(i + 1);
+            }
+
+            if (m_spilled) m_overflow.pop_back();
+            --m_size;
+        }
+
+        void Clear() {
+            // Overflow storage keeps its capacity for the next time this
+            // vector spills
+            m_overflow.clear();
+            m_spilled = false;
+            m_size = 0;
+        }
+
+        T_Element *Find(const T_Element &element) {
+            for (T_Element *i = begin(); i != end(); ++i) {
+                if (*i == element) return i;
+            }
+
+            return end();
+        }
+
+        bool Contains(const T_Element &element) const {
+            for (const T_Element *i = begin(); i != end(); ++i) {
+                if (*i == element) return true;
+            }
+
+            return false;
+        }
+
+        T_Element *begin() { return m_spilled ? m_overflow.data() : m_inline; }
+        T_Element *end() { return begin() + m_size; }
+        const T_Element *begin() const { return m_spilled ? m_overflow.data() : m_inline; }
+        const T_Element *end() const { return begin() + m_size; }
+
+        T_Element &operator[](int index) { return begin()[index]; }
+        const T_Element &operator[](int index) const { return begin()[index]; }
+
+        T_Element &Back() { return begin()[m_size - 1]; }
+
+        int GetSize() const { return m_size; }
+        bool IsEmpty() const { return m_size == 0; }
+        bool IsSpilled() const { return m_spilled; }
+
+    protected:
+        T_Element m_inline[T_InlineCapacity];
+        std::vector<T_Element> m_overflow;
+
+        int m_size;
+        bool m_spilled;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_INLINE_VECTOR_H */
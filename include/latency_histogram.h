@@ -0,0 +1,41 @@
+#ifndef TOCCATA_CORE_LATENCY_HISTOGRAM_H
+#define TOCCATA_CORE_LATENCY_HISTOGRAM_H
+
+namespace toccata {
+
+    // Counts latencies in buckets that double in width, starting at one
+    // microsecond. Recording never allocates, so histograms can be copied
+    // into snapshots freely.
+    class LatencyHistogram {
+    public:
+        static constexpr int BucketCount = 32;
+        static constexpr double FirstBucketBound = 1E-6;
+
+    public:
+        LatencyHistogram();
+        ~LatencyHistogram();
+
+        void Record(double latency);
+        void Add(const LatencyHistogram &histogram);
+        void Clear();
+
+        long long GetCount() const { return m_count; }
+        long long GetBucket(int bucket) const { return m_buckets[bucket]; }
+        double GetMax() const { return m_max; }
+
+        // Upper bound of the bucket that holds the given fraction of the
+        // samples, capped at the largest sample
+        double GetPercentile(double fraction) const;
+
+        static int GetBucketIndex(double latency);
+        static double GetBucketBound(int bucket);
+
+    protected:
+        long long m_buckets[BucketCount];
+        long long m_count;
+        double m_max;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_LATENCY_HISTOGRAM_H */
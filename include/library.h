@@ -4,12 +4,17 @@
 #include "music_segment.h"
 #include "bar.h"
 #include "piece.h"
+#include "tempo_estimator.h"
 
 #include <vector>
 
 namespace toccata {
 
     class Library {
+    public:
+        // Same as FullSolver::MaxPitches
+        static constexpr int MaxPitches = 256;
+
     public:
         Library();
         ~Library();
@@ -26,11 +31,34 @@ namespace toccata {
         Piece *GetPiece(int index) const;
         int GetPieceCount() const;
 
+        void CompileReachability();
+
+        // Groups bars whose notes are identical in timing, pitch, length,
+        // velocity and hand. Each group shares the segment of its first bar,
+        // which becomes the canonical bar of the group. Returns the number
+        // of canonical bars.
+        int CompileDuplicates();
+
+        // Fills in the summary of every bar from its notes
+        void CompileSummaries();
+
+    protected:
+        static void GetContent(const MusicSegment *segment, std::vector<MusicPoint> *content);
+        static unsigned long long HashContent(
+            const MusicSegment *segment, const std::vector<MusicPoint> &content);
+        static bool IsSameContent(
+            const MusicSegment *a,
+            const MusicSegment *b,
+            const std::vector<MusicPoint> &contentA,
+            const std::vector<MusicPoint> &contentB);
+
     protected:
         std::vector<MusicSegment *> m_segments;
         std::vector<Bar *> m_bars;
         std::vector<Piece *> m_pieces;
 
+        TempoEstimator m_tempoEstimator;
+
         int m_currentBarId;
     };
 
@@ -0,0 +1,112 @@
+#ifndef TOCCATA_CORE_LIBRARY_FILE_H
+#define TOCCATA_CORE_LIBRARY_FILE_H
+
+#include "library.h"
+
+#include <stdint.h>
+
+namespace toccata {
+
+    // Precompiled library image. Everything a Library holds is written to one
+    // file, and loading maps the file instead of reading it so the notes of
+    // every segment stay in the mapping and are only paged in when used.
+    class LibraryFile {
+    public:
+        static constexpr uint32_t Version = 2;
+
+    protected:
+        struct Header {
+            char Magic[4];
+            uint32_t Version;
+
+            // Files are only valid for the build that wrote them
+            uint32_t PointSize;
+
+            uint32_t PieceCount;
+            uint32_t SegmentCount;
+            uint32_t BarCount;
+            uint32_t LinkCount;
+            uint32_t NoteCount;
+            uint32_t PitchCount;
+            uint32_t StringSize;
+
+            uint64_t PieceOffset;
+            uint64_t SegmentOffset;
+            uint64_t BarOffset;
+            uint64_t LinkOffset;
+            uint64_t NoteOffset;
+            uint64_t PitchOffset;
+            uint64_t StringOffset;
+        };
+
+        struct PieceRecord {
+            uint32_t NameOffset;
+            uint32_t NameLength;
+        };
+
+        struct SegmentRecord {
+            double PulseUnit;
+            double PulseRate;
+            int64_t Length;
+            uint32_t FirstNote;
+            uint32_t NoteCount;
+        };
+
+        struct BarRecord {
+            int32_t Segment;
+            int32_t Piece;
+            int32_t Index;
+            int32_t Canonical;
+            uint32_t FirstLink;
+            uint32_t LinkCount;
+
+            // Summary, valid if SummaryValid is nonzero
+            uint32_t SummaryValid;
+            uint32_t FirstPitch;
+            uint32_t PitchCount;
+            double Tatum;
+            double TatumConfidence;
+        };
+
+        struct PitchRecord {
+            uint16_t Pitch;
+            uint16_t Count;
+        };
+
+    public:
+        LibraryFile();
+        ~LibraryFile();
+
+        static bool Write(const Library *library, const char *fname);
+
+        bool Open(const char *fname);
+        void Close();
+        bool IsOpen() const { return m_data != nullptr; }
+
+        // Fills an empty library. Segments refer to the notes in the mapping,
+        // so the file has to stay open for as long as the library is used.
+        // Summaries and groups of identical bars are restored without
+        // reading any notes.
+        bool Load(Library *library) const;
+
+    protected:
+        bool Validate() const;
+
+        template<typename T>
+        const T *GetSection(uint64_t offset) const {
+            return reinterpret_cast<const T *>(m_data + offset);
+        }
+
+    protected:
+        const char *m_data;
+        size_t m_size;
+
+#if defined(_WIN32)
+        void *m_file;
+        void *m_mapping;
+#endif
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_LIBRARY_FILE_H */
@@ -0,0 +1,102 @@
+#ifndef TOCCATA_CORE_MATCH_CACHE_H
+#define TOCCATA_CORE_MATCH_CACHE_H
+
+#include "music_segment.h"
+#include "transform.h"
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+
+namespace toccata {
+
+    // Remembers the solver result for each library bar and input window.
+    // Entries are placed by the position of the window and checked against a
+    // fingerprint of its content, so a result is only reused while none of
+    // the notes in its window have changed.
+    //
+    // Each bar has its own table. The same bar can be matched by several
+    // workers at once (at different start indices), so tables are guarded
+    // by a striped lock and results are copied in and out under it. Only
+    // SetBarCount, BeginPass, Trim, Release and Clear change the set of
+    // tables and they must not run while workers are matching.
+    //
+    // Tables are allocated the first time a bar is stored into and the
+    // ones that haven't been used for the longest are freed once there are
+    // more than the limit.
+    class MatchCache {
+    public:
+        static constexpr int SlotsPerBar = 256;
+        static constexpr int LockStripes = 64;
+        static constexpr int DefaultTableLimit = 1024;
+
+        struct Entry {
+            unsigned long long Fingerprint = 0;
+            bool Valid = false;
+
+            bool Found;
+            Transform T;
+            double AverageError;
+            int MappedNotes;
+            bool Singular;
+            int ReverifiedStreak;
+
+            // Sorted and relative to the start of the window
+            std::vector<int> Notes;
+        };
+
+    public:
+        MatchCache();
+        ~MatchCache();
+
+        void SetBarCount(int barCount);
+        int GetBarCount() const { return (int)m_bars.size(); }
+
+        void SetTableLimit(int limit) { m_tableLimit = limit; }
+        int GetTableLimit() const { return m_tableLimit; }
+        int GetTableCount() const { return m_tableCount; }
+
+        // Tables used from here on count as more recent than the ones used
+        // before
+        void BeginPass() { ++m_pass; }
+
+        // Copies the result for this window into target, returns false if
+        // there is none
+        bool Find(int bar, int position, unsigned long long fingerprint, Entry *target) const;
+
+        // Stores the result for this window, replacing whatever was stored
+        // in its slot
+        void Store(int bar, int position, unsigned long long fingerprint, const Entry &entry);
+
+        // Frees the least recently used tables until the count is a
+        // quarter below the limit, so that trimming doesn't run every pass
+        void Trim();
+
+        // Frees the table of a bar, e.g. once its notes have been paged out
+        void Release(int bar);
+
+        void Clear();
+
+        static unsigned long long Fingerprint(const MusicSegment *segment, int start, int end);
+        static unsigned long long Combine(unsigned long long hash, unsigned long long value);
+
+    protected:
+        std::mutex &GetLock(int bar) const { return m_locks[bar % LockStripes]; }
+
+        struct Table {
+            std::vector<Entry> Entries;
+            mutable unsigned long long LastUsed = 0;
+        };
+
+        std::vector<Table> m_bars;
+        mutable std::mutex m_locks[LockStripes];
+
+        // Tables are allocated by workers under different locks
+        std::atomic<int> m_tableCount;
+        int m_tableLimit;
+        unsigned long long m_pass;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_MATCH_CACHE_H */
@@ -4,6 +4,7 @@
 #include "component.h"
 
 #include "decision_thread.h"
+#include "residency_manager.h"
 
 namespace toccata {
 
@@ -17,12 +18,16 @@ namespace toccata {
         void SetDecisionThread(DecisionThread *thread) { m_decisionThread = thread; }
         DecisionThread *GetDecisionThread() const { return m_decisionThread; }
 
+        void SetResidency(ResidencyManager *residency) { m_residency = residency; }
+        ResidencyManager *GetResidency() const { return m_residency; }
+
     protected:
         virtual void Render();
         virtual void Update();
 
     protected:
         DecisionThread *m_decisionThread;
+        ResidencyManager *m_residency;
     };
 
 } /* namespace toccata */
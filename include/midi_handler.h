@@ -5,9 +5,13 @@
 
 #include <mutex>
 #include <chrono>
+#include <vector>
+#include <atomic>
 
 namespace toccata {
 
+    class DecisionThread;
+
     class MidiHandler {
     protected:
         MidiHandler();
@@ -18,6 +22,11 @@ namespace toccata {
     public:
         static MidiHandler *Get();
 
+        // Completed notes are sent straight to this thread as they arrive.
+        // Notes completed before the thread was set that haven't been
+        // extracted yet are sent to it first.
+        void SetDecisionThread(DecisionThread *thread);
+
         void Extract(MidiStream *targetBuffer, MidiStream *unresolvedBuffer = nullptr);
 
         void ProcessEvent(int status, int midiByte1, int midiByte2, timestamp timestamp);
@@ -26,10 +35,23 @@ namespace toccata {
 
         timestamp GetEstimatedTimestamp() const;
 
+        // Number of notes that had to wait because the decision thread's
+        // input was full. They are resent in order on the next event or
+        // extraction.
+        long long GetDeferredNoteCount() const { return m_deferredNoteCount; }
+
+    protected:
+        void SendNote(const MidiNote &note);
+        void FlushDeferredNotes();
+
     protected:
         std::mutex m_bufferLock;
         MidiStream m_buffer;
 
+        DecisionThread *m_decisionThread;
+        std::vector<MusicPoint> m_deferredNotes;
+        std::atomic<long long> m_deferredNoteCount;
+
         timestamp m_timestampOffset;
         timestamp m_lastTimestamp;
 
@@ -61,7 +61,9 @@ namespace toccata {
         void SetRawTempo(unsigned int tempo) { m_tempo = tempo; }
         unsigned int GetRawTempo() const { return m_tempo; }
 
-        void ProcessMidiEvent(
+        // Returns the index of the note completed by this event or -1 if no
+        // note was completed
+        int ProcessMidiEvent(
             int status, int byte1, int byte2, 
             timestamp t, MusicPoint::Hand hand = MusicPoint::Hand::Unknown);
 
@@ -38,6 +38,10 @@ namespace toccata {
         static int *Solve(Request *request);
         static void FreeMemorySpace(Request::MemorySpace *memory);
 
+        // Pre-faults the memory space and keeps it resident. Sizes must
+        // match the ones it was allocated with.
+        static bool LockMemorySpace(Request::MemorySpace *memory, int n, int m);
+
     private:
         enum class Step {
             Step_1,
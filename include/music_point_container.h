@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <memory>
+#include <atomic>
 
 namespace toccata {
 
@@ -14,10 +15,12 @@ namespace toccata {
             m_points = nullptr;
             m_capacity = 0;
             m_pointCount = 0;
+            m_owned = true;
+            m_viewCheck = ViewCheck::Unchecked;
         }
 
         ~MusicPointContainer() {
-            delete[] m_points;
+            if (m_owned) delete[] m_points;
         }
 
         MusicPoint *GetPoints() const { return m_points; }
@@ -26,6 +29,45 @@ namespace toccata {
         void Initialize(int n) {
             m_points = new MusicPoint[n];
             m_capacity = n;
+            m_owned = true;
+        }
+
+        // Uses sorted points owned by someone else, such as a mapped library
+        // file. They are never written to; the first change copies them.
+        void SetView(MusicPoint *points, int n) {
+            if (m_owned) delete[] m_points;
+
+            m_points = points;
+            m_capacity = n;
+            m_pointCount = n;
+            m_owned = false;
+            m_viewCheck = ViewCheck::Unchecked;
+        }
+
+        bool IsView() const { return !m_owned; }
+
+        // Points in a view come from a file that may be damaged, so their
+        // pitches are checked the first time this is called instead of when
+        // the view is set. The result is kept for the lifetime of the view,
+        // so the limit must be the same on every call. Owned points are
+        // trusted. Can be called from any thread.
+        bool CheckPitches(int limit) const {
+            if (m_owned) return true;
+
+            ViewCheck check = m_viewCheck.load(std::memory_order_acquire);
+            if (check == ViewCheck::Unchecked) {
+                check = ViewCheck::Valid;
+                for (int i = 0; i < m_pointCount; ++i) {
+                    if (m_points[i].Pitch >= limit) {
+                        check = ViewCheck::Invalid;
+                        break;
+                    }
+                }
+
+                m_viewCheck.store(check, std::memory_order_release);
+            }
+
+            return check == ViewCheck::Valid;
         }
 
         int AddPoint(const MusicPoint &point) {
@@ -36,9 +78,13 @@ namespace toccata {
                 MusicPoint *newPoints = new MusicPoint[m_capacity];
 
                 memcpy((void *)newPoints, (void *)m_points, sizeof(MusicPoint) * m_pointCount);
-                delete[] m_points;
+                if (m_owned) delete[] m_points;
 
                 m_points = newPoints;
+                m_owned = true;
+            }
+            else if (!m_owned) {
+                Detach();
             }
 
             for (int i = m_pointCount - 1; i >= 0; --i) {
@@ -56,6 +102,8 @@ namespace toccata {
             assert(index >= 0);
             assert(index < m_pointCount);
 
+            Detach();
+
             if (index != m_pointCount - 1) {
                 memmove(
                     (void *)(m_points + index),
@@ -67,11 +115,37 @@ namespace toccata {
             --m_pointCount;
         }
 
+        void RemovePoints(int index, int count) {
+            assert(index >= 0);
+            assert(count >= 0);
+            assert(index + count <= m_pointCount);
+
+            Detach();
+
+            memmove(
+                (void *)(m_points + index),
+                (void *)(m_points + index + count),
+                sizeof(MusicPoint) * ((size_t)m_pointCount - index - count)
+            );
+
+            m_pointCount -= count;
+        }
+
         void Clear() {
             m_pointCount = 0;
         }
 
     protected:
+        void Detach() {
+            if (m_owned) return;
+
+            MusicPoint *points = new MusicPoint[m_capacity];
+            memcpy((void *)points, (void *)m_points, sizeof(MusicPoint) * m_pointCount);
+
+            m_points = points;
+            m_owned = true;
+        }
+
         void InsertPoint(const MusicPoint &point, int index) {
             if (index < m_pointCount) {
                 memmove(
@@ -85,10 +159,20 @@ namespace toccata {
             ++m_pointCount;
         }
 
+    protected:
+        enum class ViewCheck : unsigned char {
+            Unchecked,
+            Valid,
+            Invalid
+        };
+
     protected:
         MusicPoint *m_points;
         int m_pointCount;
         int m_capacity;
+        bool m_owned;
+
+        mutable std::atomic<ViewCheck> m_viewCheck;
     };
 
 } /* namespace toccata */
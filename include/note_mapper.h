@@ -56,6 +56,7 @@ namespace toccata {
 
         static void AllocateMemorySpace(InjectiveMappingRequest::MemorySpace *memory, int referenceNoteCount, int noteCount);
         static void FreeMemorySpace(InjectiveMappingRequest::MemorySpace *memory);
+        static bool LockMemorySpace(InjectiveMappingRequest::MemorySpace *memory, int referenceNoteCount, int noteCount);
         static int *GetInjectiveMapping(InjectiveMappingRequest *request);
     };
 
@@ -0,0 +1,111 @@
+#ifndef TOCCATA_CORE_OBJECT_POOL_H
+#define TOCCATA_CORE_OBJECT_POOL_H
+
+#include <assert.h>
+#include <vector>
+
+namespace toccata {
+
+    struct ObjectHandle {
+        int Slot = -1;
+        unsigned int Generation = 0;
+
+        bool IsNull() const { return Slot == -1; }
+
+        bool operator==(const ObjectHandle &handle) const {
+            return Slot == handle.Slot && Generation == handle.Generation;
+        }
+
+        bool operator!=(const ObjectHandle &handle) const {
+            return !(*this == handle);
+        }
+    };
+
+    template <typename T_Object, int T_SlabSize = 256>
+    class ObjectPool {
+    public:
+        ObjectPool() {
+            m_liveCount = 0;
+            m_allocationCount = 0;
+            m_slabAllocationCount = 0;
+        }
+
+        ~ObjectPool() {
+            for (T_Object *slab : m_slabs) {
+                delete[] slab;
+            }
+        }
+
+        ObjectHandle Allocate() {
+            if (m_freeSlots.empty()) {
+                AllocateSlab();
+            }
+
+            const int slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+
+            ++m_liveCount;
+            ++m_allocationCount;
+
+            ObjectHandle handle;
+            handle.Slot = slot;
+            handle.Generation = m_generations[slot];
+
+            return handle;
+        }
+
+        void Free(ObjectHandle handle) {
+            assert(Resolve(handle) != nullptr);
+
+            // Bumping the generation invalidates every outstanding handle
+            // that still refers to this slot
+            ++m_generations[handle.Slot];
+            m_freeSlots.push_back(handle.Slot);
+
+            --m_liveCount;
+        }
+
+        T_Object *Resolve(ObjectHandle handle) const {
+            if (handle.Slot < 0 || handle.Slot >= (int)m_generations.size()) return nullptr;
+            else if (m_generations[handle.Slot] != handle.Generation) return nullptr;
+            else return Get(handle.Slot);
+        }
+
+        int GetLiveCount() const { return m_liveCount; }
+        int GetCapacity() const { return (int)m_generations.size(); }
+
+        // Statistics
+        long long GetAllocationCount() const { return m_allocationCount; }
+        long long GetSlabAllocationCount() const { return m_slabAllocationCount; }
+
+    protected:
+        T_Object *Get(int slot) const {
+            return &m_slabs[slot / T_SlabSize][slot % T_SlabSize];
+        }
+
+        void AllocateSlab() {
+            const int firstSlot = GetCapacity();
+
+            m_slabs.push_back(new T_Object[T_SlabSize]);
+            m_generations.resize((size_t)firstSlot + T_SlabSize, 0);
+
+            for (int i = T_SlabSize - 1; i >= 0; --i) {
+                m_freeSlots.push_back(firstSlot + i);
+            }
+
+            ++m_slabAllocationCount;
+        }
+
+    protected:
+        std::vector<T_Object *> m_slabs;
+        std::vector<unsigned int> m_generations;
+        std::vector<int> m_freeSlots;
+
+        int m_liveCount;
+        long long m_allocationCount;
+        long long m_slabAllocationCount;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_OBJECT_POOL_H */
@@ -0,0 +1,102 @@
+#ifndef TOCCATA_CORE_RESIDENCY_MANAGER_H
+#define TOCCATA_CORE_RESIDENCY_MANAGER_H
+
+#include "library.h"
+
+#include <list>
+#include <mutex>
+#include <vector>
+
+namespace toccata {
+
+    // Keeps the notes of recently used pieces in memory and lets the
+    // operating system drop the rest. Only notes that live in a mapped
+    // library file (see LibraryFile) are managed; the bars, segments and
+    // summaries always stay resident.
+    //
+    // Pieces are paged in when one of their bars is about to be matched and
+    // the least recently used ones are evicted once the budget is exceeded.
+    // Every method can be called from any thread.
+    class ResidencyManager {
+    public:
+        struct Statistics {
+            // Bars touched whose piece was or wasn't resident
+            long long Hits = 0;
+            long long Misses = 0;
+
+            long long Prefetches = 0;
+            long long Evictions = 0;
+
+            size_t ResidentBytes = 0;
+            int ResidentPieces = 0;
+
+            double GetHitRate() const {
+                return (Hits + Misses > 0)
+                    ? Hits / (double)(Hits + Misses)
+                    : 0.0;
+            }
+        };
+
+    protected:
+        struct Range {
+            const char *Begin;
+            size_t Size;
+        };
+
+        struct Group {
+            std::vector<Range> Ranges;
+            size_t Bytes = 0;
+
+            std::vector<int> Bars;
+
+            bool Resident = false;
+            std::list<int>::iterator Position;
+        };
+
+    public:
+        ResidencyManager();
+        ~ResidencyManager();
+
+        // Groups the library's bars by piece. Bars without a piece are
+        // grouped on their own. A budget of zero never evicts.
+        void Initialize(const Library *library, size_t budget);
+
+        void SetBudget(size_t budget);
+        size_t GetBudget() const { return m_budget; }
+
+        // Call before reading a bar's notes. Returns true if its piece
+        // was already resident.
+        bool Touch(const Bar *bar);
+
+        // Starts paging in a bar's piece without waiting for it
+        void Prefetch(const Bar *bar);
+
+        bool IsResident(const Bar *bar);
+
+        // Appends the bars of every piece evicted since the last call, so
+        // that whatever is kept per bar can be dropped along with the notes
+        void DrainEvicted(std::vector<int> *bars);
+
+        Statistics GetStatistics();
+
+    protected:
+        void MakeResident(int group, bool prefetch);
+        void EvictOver(int keep);
+
+    protected:
+        std::vector<Group> m_groups;
+        std::vector<int> m_barGroups;
+
+        // Most recently used first
+        std::list<int> m_recent;
+        std::vector<int> m_evicted;
+
+        size_t m_budget;
+        Statistics m_statistics;
+
+        std::mutex m_lock;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_RESIDENCY_MANAGER_H */
@@ -47,6 +47,23 @@ namespace toccata {
         ysVector NumericInput_EnabledOuterColor = ysMath::Constants::Zero;
         ysVector NumericInput_DisabledOuterColor = ysMath::Constants::Zero;
 
+        int DecisionThread_MinimumWorkers = 1;
+        int DecisionThread_MaximumWorkers = 1;
+        double DecisionThread_TargetLatency = 0.005;
+
+        // Opt-in real-time mode. The policy is 0 for the default scheduler,
+        // 1 for FIFO and 2 for round robin.
+        int DecisionThread_Realtime = 0;
+        int DecisionThread_CpuMask = 0;
+        int DecisionThread_SchedulingPolicy = 0;
+        int DecisionThread_Priority = 1;
+        int DecisionThread_LockMemory = 0;
+
+        int DecisionThread_ScoreFollowing = 0;
+
+        // Megabytes of library notes kept resident, zero for no limit
+        int Library_ResidencyBudget = 0;
+
         template <typename T_Setting>
         void FillSetting(T_Setting *setting, const std::string &name, Profile *profile, Profile *defaultProfile) {
             if (profile == nullptr || !profile->GetSetting(name, setting)) {
@@ -104,6 +121,18 @@ namespace toccata {
             SETTING(NumericInput_InnerColor);
             SETTING(NumericInput_EnabledOuterColor);
             SETTING(NumericInput_DisabledOuterColor);
+
+            SETTING(DecisionThread_MinimumWorkers);
+            SETTING(DecisionThread_MaximumWorkers);
+            SETTING(DecisionThread_TargetLatency);
+            SETTING(DecisionThread_Realtime);
+            SETTING(DecisionThread_CpuMask);
+            SETTING(DecisionThread_SchedulingPolicy);
+            SETTING(DecisionThread_Priority);
+            SETTING(DecisionThread_LockMemory);
+            SETTING(DecisionThread_ScoreFollowing);
+
+            SETTING(Library_ResidencyBudget);
         }
     };
 
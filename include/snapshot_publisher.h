@@ -0,0 +1,158 @@
+#ifndef TOCCATA_CORE_SNAPSHOT_PUBLISHER_H
+#define TOCCATA_CORE_SNAPSHOT_PUBLISHER_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace toccata {
+
+    // Publishes immutable snapshots from a writer to any number of readers
+    // without locks. Replaced snapshots are only reused once no reader that
+    // could still see them is active (epoch-based reclamation).
+    //
+    // Calls to BeginWrite and Publish must not overlap. Up to T_MaxReaders
+    // readers can hold a snapshot at the same time.
+    template <typename T_Snapshot, int T_MaxReaders = 4>
+    class SnapshotPublisher {
+    protected:
+        static constexpr unsigned long long Inactive = 0;
+
+        struct Retired {
+            T_Snapshot *Snapshot;
+            unsigned long long Epoch;
+        };
+
+    public:
+        class ReadGuard {
+            friend class SnapshotPublisher;
+
+        public:
+            ReadGuard(ReadGuard &&guard) {
+                m_slot = guard.m_slot;
+                m_snapshot = guard.m_snapshot;
+                guard.m_slot = nullptr;
+            }
+
+            ~ReadGuard() {
+                if (m_slot != nullptr) m_slot->store(Inactive);
+            }
+
+            const T_Snapshot *operator->() const { return m_snapshot; }
+            const T_Snapshot &operator*() const { return *m_snapshot; }
+
+        protected:
+            ReadGuard(std::atomic<unsigned long long> *slot, const T_Snapshot *snapshot) {
+                m_slot = slot;
+                m_snapshot = snapshot;
+            }
+
+            ReadGuard(const ReadGuard &) = delete;
+            ReadGuard &operator=(const ReadGuard &) = delete;
+
+            std::atomic<unsigned long long> *m_slot;
+            const T_Snapshot *m_snapshot;
+        };
+
+    public:
+        SnapshotPublisher() {
+            for (int i = 0; i < T_MaxReaders; ++i) {
+                m_readerEpochs[i] = Inactive;
+            }
+
+            m_epoch = 1;
+            m_current = new T_Snapshot;
+            m_retiredCount = 0;
+            m_reclaimedCount = 0;
+        }
+
+        ~SnapshotPublisher() {
+            delete m_current.load();
+
+            for (const Retired &retired : m_retired) delete retired.Snapshot;
+            for (T_Snapshot *snapshot : m_free) delete snapshot;
+        }
+
+        // Returns the latest snapshot. It stays valid until the guard is
+        // destroyed, even if newer snapshots are published in the meantime.
+        ReadGuard Read() {
+            for (;;) {
+                for (int i = 0; i < T_MaxReaders; ++i) {
+                    unsigned long long expected = Inactive;
+                    if (m_readerEpochs[i].compare_exchange_strong(expected, m_epoch.load())) {
+                        return ReadGuard(&m_readerEpochs[i], m_current.load());
+                    }
+                }
+
+                // Every slot is taken
+                std::this_thread::yield();
+            }
+        }
+
+        // Returns a snapshot that no reader can see. Its contents are
+        // whatever was last written to it.
+        T_Snapshot *BeginWrite() {
+            Reclaim();
+
+            if (m_free.empty()) return new T_Snapshot;
+
+            T_Snapshot *snapshot = m_free.back();
+            m_free.pop_back();
+
+            return snapshot;
+        }
+
+        void Publish(T_Snapshot *snapshot) {
+            T_Snapshot *previous = m_current.exchange(snapshot);
+            m_retired.push_back({ previous, m_epoch.fetch_add(1) });
+            ++m_retiredCount;
+
+            Reclaim();
+        }
+
+        // Writer side only
+        const T_Snapshot *GetCurrent() const { return m_current.load(); }
+
+        long long GetRetiredCount() const { return m_retiredCount; }
+        long long GetReclaimedCount() const { return m_reclaimedCount; }
+        int GetPendingCount() const { return (int)m_retired.size(); }
+
+    protected:
+        void Reclaim() {
+            // Readers that entered at or before a snapshot's retirement epoch
+            // may still hold it
+            unsigned long long oldestReader = ~0ull;
+            for (int i = 0; i < T_MaxReaders; ++i) {
+                const unsigned long long epoch = m_readerEpochs[i].load();
+                if (epoch != Inactive && epoch < oldestReader) oldestReader = epoch;
+            }
+
+            int kept = 0;
+            for (const Retired &retired : m_retired) {
+                if (retired.Epoch < oldestReader) {
+                    m_free.push_back(retired.Snapshot);
+                    ++m_reclaimedCount;
+                }
+                else {
+                    m_retired[kept++] = retired;
+                }
+            }
+
+            m_retired.resize(kept);
+        }
+
+    protected:
+        std::atomic<T_Snapshot *> m_current;
+        std::atomic<unsigned long long> m_epoch;
+        std::atomic<unsigned long long> m_readerEpochs[T_MaxReaders];
+
+        std::vector<Retired> m_retired;
+        std::vector<T_Snapshot *> m_free;
+
+        long long m_retiredCount;
+        long long m_reclaimedCount;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_SNAPSHOT_PUBLISHER_H */
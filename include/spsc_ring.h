@@ -0,0 +1,71 @@
+#ifndef TOCCATA_CORE_SPSC_RING_H
+#define TOCCATA_CORE_SPSC_RING_H
+
+#include <atomic>
+
+namespace toccata {
+
+    // Fixed size queue between exactly one producer thread and one consumer
+    // thread. Push and Pop never block or allocate. The capacity must be a
+    // power of two.
+    template <typename T_Element, int T_Capacity>
+    class SpscRing {
+        static_assert((T_Capacity & (T_Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscRing() {
+            m_head = 0;
+            m_tail = 0;
+        }
+
+        ~SpscRing() {
+            /* void */
+        }
+
+        // Producer only. Returns false if the ring is full.
+        bool Push(const T_Element &element) {
+            const unsigned int tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == T_Capacity) return false;
+
+            m_elements[tail & Mask] = element;
+            m_tail.store(tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // Consumer only. Returns false if the ring is empty.
+        bool Pop(T_Element *element) {
+            const unsigned int head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+            *element = m_elements[head & Mask];
+            m_head.store(head + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool IsEmpty() const {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        int GetSize() const {
+            return (int)(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+        }
+
+        static constexpr int GetCapacity() { return T_Capacity; }
+
+    protected:
+        static constexpr unsigned int Mask = T_Capacity - 1;
+
+        T_Element m_elements[T_Capacity];
+
+        // Padded onto separate cache lines so that the two threads don't
+        // invalidate each other's index on every operation
+        std::atomic<unsigned int> m_head;
+        char m_padding[64];
+        std::atomic<unsigned int> m_tail;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_SPSC_RING_H */
@@ -0,0 +1,57 @@
+#ifndef TOCCATA_CORE_TEMPO_ESTIMATOR_H
+#define TOCCATA_CORE_TEMPO_ESTIMATOR_H
+
+#include "music_segment.h"
+
+#include <vector>
+
+namespace toccata {
+
+    // Estimates the tatum, the shortest regular interval between onsets,
+    // from note timestamps alone. Intervals between onsets are scored by
+    // how well every other interval is a small multiple of them.
+    class TempoEstimator {
+    public:
+        // Largest multiple of the tatum an interval can be explained by
+        static constexpr int MaxMultiple = 4;
+
+        // Relative timing error of an interval that still counts as a
+        // multiple of the tatum, as one standard deviation
+        static constexpr double Deviation = 0.05;
+
+        // Onsets closer than this fraction of the upper quartile interval
+        // are treated as one chord
+        static constexpr double ChordFraction = 0.25;
+
+        struct Estimate {
+            bool Valid = false;
+
+            // In normalized segment time
+            double Tatum = 0.0;
+
+            // Fraction of the intervals explained by the tatum, from 0 to 1
+            double Confidence = 0.0;
+        };
+
+    public:
+        TempoEstimator();
+        ~TempoEstimator();
+
+        // Uses the onsets of the notes with indices in [start, end]
+        Estimate EstimateTatum(const MusicSegment *segment, int start, int end);
+
+        // Checks whether a transform scale is plausible given the tatums
+        // of the reference and the input. Under the scale, the reference
+        // tatum has to land on a small multiple or fraction of the input
+        // tatum.
+        static bool IsConsistent(double referenceTatum, double inputTatum, double s, double tolerance);
+
+    protected:
+        std::vector<double> m_onsets;
+        std::vector<double> m_intervals;
+        std::vector<double> m_sorted;
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_TEMPO_ESTIMATOR_H */
@@ -0,0 +1,52 @@
+#ifndef TOCCATA_CORE_TEMPO_TRACKER_H
+#define TOCCATA_CORE_TEMPO_TRACKER_H
+
+namespace toccata {
+
+    // Kalman filter over the time a bar starts and the period, the input
+    // time per unit of reference time (1 / s), along a branch of matched
+    // bars. Times are normalized input times.
+    class TempoTracker {
+    public:
+        // Expected drift per bar, as standard deviations relative to the
+        // period: the boundary drifts by a fraction of the bar and the
+        // tempo by a fraction of itself
+        static constexpr double BoundaryDrift = 0.05;
+        static constexpr double PeriodDrift = 0.03;
+
+        // Measurement noise of a single bar match, relative to the period
+        static constexpr double BoundaryNoise = 0.1;
+        static constexpr double PeriodNoise = 0.05;
+
+    public:
+        TempoTracker();
+        ~TempoTracker();
+
+        void Reset();
+        void Initialize(double boundary, double period);
+
+        // Moves the state to the start of the next bar, given the
+        // normalized length of the bar that was tracked last
+        void Predict(double barLength);
+
+        // Folds in the boundary and period measured for the bar
+        void Update(double boundary, double period);
+
+        bool IsValid() const { return m_valid; }
+
+        double GetBoundary() const { return m_boundary; }
+        double GetPeriod() const { return m_period; }
+        double GetBoundaryVariance() const { return m_covariance[0][0]; }
+        double GetPeriodVariance() const { return m_covariance[1][1]; }
+
+    protected:
+        bool m_valid;
+
+        double m_boundary;
+        double m_period;
+        double m_covariance[2][2];
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_TEMPO_TRACKER_H */
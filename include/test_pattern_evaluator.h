@@ -4,8 +4,10 @@
 #include "music_segment.h"
 #include "note_mapper.h"
 #include "transform.h"
+#include "tempo_estimator.h"
 
 #include <random>
+#include <cfloat>
 
 namespace toccata {
 
@@ -14,6 +16,10 @@ namespace toccata {
         static constexpr bool EnablePreciseMapping = false;
         static constexpr bool UsePitchCachingInMappingStep = true;
 
+        // Relative error allowed between the tatum ratio implied by a
+        // hypothesis and the nearest whole ratio
+        static constexpr double TatumTolerance = 0.1;
+
     public:
         struct Request {
             struct MemorySpace {
@@ -37,6 +43,17 @@ namespace toccata {
             const int *TestPattern;
             int TestPatternLength;
 
+            // Hypotheses with a scale outside these bounds are dropped
+            // before their mapping is computed
+            double MinScale = 0.0;
+            double MaxScale = DBL_MAX;
+
+            // Tatums estimated from the onsets alone. Hypotheses that don't
+            // relate them by a small whole ratio are dropped as well. Zero
+            // disables the check.
+            double ReferenceTatum = 0.0;
+            double InputTatum = 0.0;
+
             MemorySpace Memory;
         };
 
@@ -47,6 +64,10 @@ namespace toccata {
             int MappedNotes;
             int MappingStart;
             int MappingEnd;
+
+            // Hypotheses that passed the scale bounds and the tatum check
+            // and were mapped
+            int EvaluatedHypotheses;
         };
 
         static void AllocateMemorySpace(
@@ -57,6 +78,14 @@ namespace toccata {
         );
 
         static void FreeMemorySpace(Request::MemorySpace *memory);
+
+        static bool LockMemorySpace(
+            Request::MemorySpace *memory,
+            int testPatternSize,
+            int referenceSegmentNotes,
+            int segmentNotes
+        );
+
         static bool Solve(const Request &request, Output *output);
 
     private:
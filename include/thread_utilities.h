@@ -0,0 +1,68 @@
+#ifndef TOCCATA_CORE_THREAD_UTILITIES_H
+#define TOCCATA_CORE_THREAD_UTILITIES_H
+
+#include <stddef.h>
+
+namespace toccata {
+
+    // Scheduling controls for latency sensitive threads. Every call applies
+    // to the calling thread and returns false instead of failing hard when
+    // the platform or the process's permissions don't allow it.
+    class ThreadUtilities {
+    public:
+        enum class SchedulingPolicy {
+            Default,
+            Fifo,
+            RoundRobin
+        };
+
+        struct RealtimeSettings {
+            bool Enabled = false;
+
+            // Bit i allows the thread to run on CPU i. Zero leaves the
+            // affinity alone.
+            unsigned long long CpuMask = 0;
+
+            // Windows has no real-time policies, so both map to the highest
+            // thread priority there and Priority is ignored
+            SchedulingPolicy Policy = SchedulingPolicy::Default;
+            int Priority = 1;
+
+            // Pre-faults solver memory and keeps it resident
+            bool LockMemory = false;
+        };
+
+    public:
+        static bool SetAffinity(unsigned long long cpuMask);
+        static bool SetScheduling(SchedulingPolicy policy, int priority);
+
+        // Returns true only if every requested setting could be applied
+        static bool Apply(const RealtimeSettings &settings);
+
+        // Touches every page so that first use doesn't take a page fault.
+        // The contents are left unchanged.
+        static void Prefault(void *memory, size_t size);
+        static bool LockMemory(void *memory, size_t size);
+
+        template<typename T>
+        static bool Lock(T *memory, int n) {
+            Prefault(memory, sizeof(T) * n);
+            return LockMemory(memory, sizeof(T) * n);
+        }
+
+        // Rows are found the same way Memory::Free2d finds them
+        template<typename T>
+        static bool Lock2d(T **memory, int m) {
+            int n = 0;
+            bool locked = true;
+            for (; memory[n] != nullptr; ++n) {
+                locked = Lock(memory[n], m) && locked;
+            }
+
+            return Lock(memory, n + 1) && locked;
+        }
+    };
+
+} /* namespace toccata */
+
+#endif /* TOCCATA_CORE_THREAD_UTILITIES_H */
@@ -10,10 +10,12 @@
 #include "../include/settings_manager.h"
 #include "../include/grid.h"
 
+#include <algorithm>
 #include <sstream>
 
 toccata::Application::Application() {
     m_currentOffset = 0.0;
+    m_snapshotVersion = -1;
 }
 
 toccata::Application::~Application() {
@@ -86,6 +88,7 @@ void toccata::Application::Initialize(void *instance, ysContextObject::DeviceAPI
     m_metricsPanel.Initialize(&m_engine, &m_shaders, &m_textRenderer, &m_settings);
 
     m_metricsPanel.SetDecisionThread(&m_decisionThread);
+    m_metricsPanel.SetResidency(&m_residency);
 
     ReloadThemes();
 
@@ -234,7 +237,6 @@ void toccata::Application::ProcessMidiInput() {
         point.Timestamp = note.Timestamp;
         point.Velocity = note.Velocity;
         point.Length = note.NoteLength;
-        m_decisionThread.AddNote(point);
         m_testSegment.NoteContainer.AddPoint(point);
     }
 
@@ -274,6 +276,11 @@ void toccata::Application::CheckMidiStatus() {
 }
 
 void toccata::Application::ConstructReferenceNotes() {
+    // Nothing to rebuild until the decision thread publishes new results
+    const long long snapshotVersion = m_decisionThread.GetSnapshotVersion();
+    if (snapshotVersion == m_snapshotVersion) return;
+
+    m_snapshotVersion = snapshotVersion;
     m_referenceSegment.NoteContainer.Clear();
 
     m_timeline.ClearBars();
@@ -300,10 +307,13 @@ void toccata::Application::ReloadThemes() {
 }
 
 void toccata::Application::Run() {
-    InitializeMidiInput();
     InitializeLibrary();
     InitializeDecisionThread();
 
+    // Connected last so that every note played is seen by the decision
+    // thread as well as the UI
+    InitializeMidiInput();
+
     while (m_engine.IsOpen()) {
         m_engine.StartFrame();
 
@@ -315,6 +325,7 @@ void toccata::Application::Run() {
         m_engine.EndFrame();
     }
 
+    MidiHandler::Get()->SetDecisionThread(nullptr);
     m_decisionThread.KillThreads();
     m_decisionThread.Destroy();
 }
@@ -326,6 +337,20 @@ void toccata::Application::Destroy() {
 }
 
 void toccata::Application::InitializeLibrary() {
+    // Compiled from the MIDI files on the first run. Delete it to pick up
+    // changes to the sources.
+    static const char *compiledPath = "../../test/midi/library.tlib";
+
+    const size_t residencyBudget =
+        (size_t)std::max(0, m_settings.Library_ResidencyBudget) * 1024 * 1024;
+
+    if (m_libraryFile.Open(compiledPath) && m_libraryFile.Load(&m_library)) {
+        m_residency.Initialize(&m_library, residencyBudget);
+        return;
+    }
+
+    m_libraryFile.Close();
+
     static const std::string paths[] = 
     {
         "../../test/midi/simple_passage.midi",
@@ -341,11 +366,38 @@ void toccata::Application::InitializeLibrary() {
 
         toccata::SegmentGenerator::Convert(&stream, &m_library, name, 0);
     }
+
+    m_library.CompileReachability();
+    m_library.CompileDuplicates();
+    m_library.CompileSummaries();
+
+    LibraryFile::Write(&m_library, compiledPath);
+
+    // Notes converted from MIDI stay on the heap until the next start
+    m_residency.Initialize(&m_library, residencyBudget);
 }
 
 void toccata::Application::InitializeDecisionThread() {
-    m_decisionThread.Initialize(&m_library, 1, 1000.0, 1.0);
+    const int maximumWorkers = std::max(1, m_settings.DecisionThread_MaximumWorkers);
+
+    m_decisionThread.Initialize(&m_library, maximumWorkers, 1000.0, 1.0);
+    m_decisionThread.SetWorkerLimits(m_settings.DecisionThread_MinimumWorkers, maximumWorkers);
+    m_decisionThread.SetTargetLatency(m_settings.DecisionThread_TargetLatency);
+
+    ThreadUtilities::RealtimeSettings realtime;
+    realtime.Enabled = m_settings.DecisionThread_Realtime != 0;
+    realtime.CpuMask = (unsigned int)m_settings.DecisionThread_CpuMask;
+    realtime.Policy = (ThreadUtilities::SchedulingPolicy)
+        std::max(0, std::min(m_settings.DecisionThread_SchedulingPolicy, 2));
+    realtime.Priority = m_settings.DecisionThread_Priority;
+    realtime.LockMemory = m_settings.DecisionThread_LockMemory != 0;
+    m_decisionThread.SetRealtimeSettings(realtime);
+
+    m_decisionThread.GetTree()->SetFollowerEnabled(m_settings.DecisionThread_ScoreFollowing != 0);
+    m_decisionThread.GetTree()->SetResidency(&m_residency);
+
     m_decisionThread.StartThreads();
+    MidiHandler::Get()->SetDecisionThread(&m_decisionThread);
 }
 
 void toccata::Application::InitializeMidiInput() {
@@ -1,8 +1,12 @@
 #include "../include/bar.h"
 
+#include <algorithm>
+#include <assert.h>
+
 toccata::Bar::Bar() {
     m_segment = nullptr;
     m_piece = nullptr;
+    m_canonical = this;
     m_id = -1;
 }
 
@@ -10,8 +14,23 @@ toccata::Bar::~Bar() {
     /* void */
 }
 
-void toccata::Bar::AddNext(Bar *next) {
+void toccata::Bar::AddNext(Bar *next, bool updateReachability) {
     m_next.push_back(next);
+    next->m_previous.push_back(this);
+
+    if (updateReachability) UpdateReachability();
+}
+
+void toccata::Bar::SetCanonical(Bar *canonical) {
+    m_canonical = canonical;
+
+    if (canonical == this) {
+        m_duplicates.clear();
+    }
+    else {
+        assert(canonical->IsCanonical());
+        canonical->m_duplicates.push_back(this);
+    }
 }
 
 toccata::Bar *toccata::Bar::GetNext(int index) const {
@@ -19,6 +38,21 @@ toccata::Bar *toccata::Bar::GetNext(int index) const {
 }
 
 toccata::Bar::SearchResult toccata::Bar::FindNext(const Bar *next, int skipsAllowed) const {
+    if (skipsAllowed <= MaxCompiledSkips) {
+        auto route = m_routes[skipsAllowed].find(next);
+        if (route == m_routes[skipsAllowed].end()) return { -1, -1 };
+
+        const int nextLength = next->GetSegment()->NoteContainer.GetCount();
+        const int skips = route->second.Skips;
+
+        double distance = 0.0;
+        for (int i = 0; i < skips; ++i) {
+            distance += route->second.Path[i]->GetSegment()->GetNormalizedLength();
+        }
+
+        return { skips * nextLength, distance };
+    }
+
     const double length = GetSegment()->GetNormalizedLength();
     for (const Bar *n : m_next) {
         if (n == next) return { 0, 0.0 };
@@ -33,3 +67,56 @@ toccata::Bar::SearchResult toccata::Bar::FindNext(const Bar *next, int skipsAllo
 
     return { -1, -1 };
 }
+
+void toccata::Bar::CompileReachability(int skips) {
+    std::unordered_map<const Bar *, Route> &routes = m_routes[skips];
+    routes.clear();
+
+    // Successors are visited in the same order as the search in FindNext so
+    // the first route found wins
+    for (const Bar *n : m_next) {
+        Route direct;
+        direct.Skips = 0;
+        routes.insert({ n, direct });
+
+        if (skips == 0) continue;
+
+        for (const auto &entry : n->m_routes[skips - 1]) {
+            if (routes.count(entry.first) > 0) continue;
+
+            Route route;
+            route.Skips = entry.second.Skips + 1;
+            route.Path[0] = this;
+            for (int i = 0; i < entry.second.Skips; ++i) {
+                route.Path[i + 1] = entry.second.Path[i];
+            }
+
+            routes.insert({ entry.first, route });
+        }
+    }
+}
+
+void toccata::Bar::UpdateReachability() {
+    // Only this bar and bars that can reach it within the maximum number of
+    // skips have routes through the new link
+    std::vector<Bar *> affected = { this };
+    int levelStart = 0;
+    for (int i = 0; i < MaxCompiledSkips; ++i) {
+        const int levelEnd = (int)affected.size();
+        for (int j = levelStart; j < levelEnd; ++j) {
+            for (Bar *previous : affected[j]->m_previous) {
+                if (std::find(affected.begin(), affected.end(), previous) == affected.end()) {
+                    affected.push_back(previous);
+                }
+            }
+        }
+
+        levelStart = levelEnd;
+    }
+
+    for (int skips = 0; skips <= MaxCompiledSkips; ++skips) {
+        for (Bar *bar : affected) {
+            bar->CompileReachability(skips);
+        }
+    }
+}
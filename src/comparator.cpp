@@ -23,7 +23,7 @@ bool toccata::Comparator::CalculateError(const Request &request, Result *result)
         if (mapped < mappingStart) mappingStart = mapped;
 
         if (result->Target != nullptr) {
-            result->Target->insert(mapped);
+            result->Target->push_back(mapped);
         }
 
         const MusicPoint &ref = referencePoints[i];
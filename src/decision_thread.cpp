@@ -1,20 +1,56 @@
 #include "../include/decision_thread.h"
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
 
 toccata::DecisionThread::DecisionThread() {
-    m_currentIndex = 0;
+    m_iterationsSincePublish = 0;
+    m_snapshotVersion = 0;
+    m_metricsReadVersion = -1;
     m_complete = true;
+
+    m_horizonBars = 0;
+    m_horizonSeconds = 0.0;
+    m_indexOffset = 0;
     m_kill = false;
 
+    m_spinWindow = DefaultSpinWindow;
+    m_iterationBudget = 0.0;
+
+    m_threadCount = 0;
+    m_minimumWorkers = 0;
+    m_maximumWorkers = 0;
+    m_activeWorkers = 0;
+    m_targetLatency = DefaultTargetLatency;
+    m_realtimeFailures = 0;
+    m_parked = false;
+    m_iterations = 0;
+    m_workAdded = 0;
+
+    m_inFlight = false;
+    m_inFlightStart = 0;
+    m_inFlightEnd = 0;
+
     m_peakIndex = 0;
     m_peakIndexReset = true;
 
     m_peakLatency = 0.0;
     m_peakLatencyReset = true;
 
+    m_peakActiveWorkers = 0;
+    m_peakActiveWorkersReset = true;
+
+    m_stageLatencyReset = true;
+
     m_peakTargetIndex = 0;
     m_peakTargetIndexReset = true;
+
+    m_peakWakeLatency = 0.0;
+    m_peakWakeLatencyReset = true;
+
+    m_idleTime = 0.0;
+    m_idleWindowStart = std::chrono::steady_clock::now();
 }
 
 toccata::DecisionThread::~DecisionThread() {
@@ -26,6 +62,11 @@ void toccata::DecisionThread::Initialize(Library *library, int threadCount, doub
     m_tree.SetInputSegment(&m_inputBuffer);
     m_tree.Initialize(threadCount);
 
+    m_threadCount = threadCount;
+    m_minimumWorkers = threadCount;
+    m_maximumWorkers = threadCount;
+    m_activeWorkers = threadCount;
+
     m_complete = false;
     m_kill = false;
 
@@ -40,7 +81,11 @@ void toccata::DecisionThread::StartThreads() {
 }
 
 void toccata::DecisionThread::KillThreads() {
+    m_parkLock.lock();
     m_kill = true;
+    m_parkLock.unlock();
+
+    m_workAvailable.notify_one();
     m_thread.join();
 
     m_tree.KillThreads();
@@ -53,61 +98,452 @@ void toccata::DecisionThread::Destroy() {
 void toccata::DecisionThread::DoIteration() {
     m_bufferLock.lock();
 
+    // Each iteration runs the stages in order: ingest new notes, match a
+    // slice of bar tasks, integrate the results and publish a snapshot
+    const auto ingestStart = std::chrono::steady_clock::now();
+    if (DrainInput()) {
+        RecordStageLatency(Stage::Ingest, ingestStart);
+    }
+
     const int noteCount = m_inputBuffer.NoteContainer.GetCount();
 
     auto start = std::chrono::steady_clock::now();    
 
-    if (m_currentIndex < noteCount) {
-        m_tree.Process(m_currentIndex++);
+    bool caughtUp = false;
+    if (m_tree.IsPassPending() || !m_dirty.IsEmpty()) {
+        if (Match(start)) {
+            const auto integrateStart = std::chrono::steady_clock::now();
+            m_tree.IntegrateSlice();
+            RecordStageLatency(Stage::Integrate, integrateStart);
+        }
+    }
+    else {
+        ApplyHorizon();
+        caughtUp = true;
     }
-    else m_complete = true;
 
     auto end = std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed = end - start;
 
     RecordLatency(elapsed.count());
-    RecordIndex(m_currentIndex);
+    RecordIndex(GetPendingIndex());
     RecordTargetIndex(noteCount);
 
+    UpdateWorkerCount(elapsed.count(), caughtUp);
+
+    ++m_iterationsSincePublish;
+    if (caughtUp || m_iterationsSincePublish >= SnapshotPublishInterval) {
+        const auto publishStart = std::chrono::steady_clock::now();
+        PublishSnapshot();
+        RecordStageLatency(Stage::Publish, publishStart);
+    }
+
+    // Only reported once the published pieces are up to date
+    if (caughtUp) m_complete = true;
+
+    ++m_iterations;
+
     m_bufferLock.unlock();
 }
 
 void toccata::DecisionThread::RunThread() {
+    if (!ThreadUtilities::Apply(m_tree.GetRealtimeSettings())) ++m_realtimeFailures;
+
     while (!m_kill) {
         DoIteration();
+
+        if (m_complete) {
+            WaitForWork();
+        }
     }
 }
 
-void toccata::DecisionThread::AddNote(const MusicPoint &point) {
+void toccata::DecisionThread::SetWorkerLimits(int minimum, int maximum) {
     m_bufferLock.lock();
 
-    const int index = m_inputBuffer.NoteContainer.AddPoint(point);
-    m_tree.OnNoteChange(index);
+    m_maximumWorkers = std::max(1, std::min(maximum, m_threadCount));
+    m_minimumWorkers = std::max(1, std::min(minimum, m_maximumWorkers));
 
-    m_currentIndex = std::min(
-        m_currentIndex,
-        std::max(0, index - 128));
-    m_complete = false;
+    // Workers are only added once there is work that needs them
+    m_activeWorkers = m_minimumWorkers;
+    m_tree.SetActiveThreadCount(m_activeWorkers);
 
     m_bufferLock.unlock();
 }
 
+void toccata::DecisionThread::UpdateWorkerCount(double latency, bool caughtUp) {
+    if (caughtUp) {
+        // Nothing to do until the next note arrives
+        m_activeWorkers = m_minimumWorkers;
+    }
+    else {
+        // Expected time until the thread has caught up with the input if
+        // iterations keep taking as long as this one
+        const double backlog = m_dirty.GetSize() / (double)PipelineDepth;
+        const double catchUpTime = latency * (1 + backlog);
+
+        if (catchUpTime > m_targetLatency) ++m_activeWorkers;
+        else if (catchUpTime < 0.5 * m_targetLatency) --m_activeWorkers;
+
+        m_activeWorkers = std::max(m_minimumWorkers, std::min(m_activeWorkers, m_maximumWorkers));
+    }
+
+    m_tree.SetActiveThreadCount(m_activeWorkers);
+    RecordActiveWorkers(m_activeWorkers);
+}
+
+void toccata::DecisionThread::WaitForWork() {
+    // Notes tend to arrive in quick succession, so poll for a short while
+    // before paying for a full park and wake-up
+    const auto spinStart = std::chrono::steady_clock::now();
+    while (m_input.IsEmpty() && !m_kill) {
+        const std::chrono::duration<double> spinTime =
+            std::chrono::steady_clock::now() - spinStart;
+        if (spinTime.count() >= m_spinWindow) break;
+
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lk(m_parkLock);
+
+    m_parked = true;
+
+    // Pairs with the fence in AddNote so that either the producer sees the
+    // thread parked or the thread sees the new note
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (m_input.IsEmpty() && !m_kill) {
+        m_idleStart = std::chrono::steady_clock::now();
+
+        m_workAvailable.wait(lk, [this] { return !m_input.IsEmpty() || m_kill; });
+
+        const auto wake = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> idle = wake - std::max(m_idleStart, m_idleWindowStart);
+        m_idleTime += idle.count();
+    }
+
+    m_parked = false;
+    lk.unlock();
+
+    if (!m_kill) {
+        const std::chrono::steady_clock::duration sinceAdded =
+            std::chrono::steady_clock::now().time_since_epoch() -
+            std::chrono::steady_clock::duration(m_workAdded.load());
+        const std::chrono::duration<double> wakeLatency = sinceAdded;
+
+        m_bufferLock.lock();
+        RecordWakeLatency(wakeLatency.count());
+        m_bufferLock.unlock();
+    }
+}
+
+bool toccata::DecisionThread::AddNote(const MusicPoint &point) {
+    NoteEvent event;
+    event.Timestamp = point.Timestamp;
+    event.Pitch = point.Pitch;
+    event.Length = point.Length;
+    event.Velocity = point.Velocity;
+
+    m_workAdded = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (!m_input.Push(event)) return false;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (m_inFlight) {
+        const timestamp t = point.Timestamp;
+        if (t > m_inFlightStart && t <= m_inFlightEnd) {
+            m_cancel.Cancel();
+        }
+    }
+
+    if (m_parked) {
+        // Taking the lock guarantees that the thread is either already
+        // waiting or hasn't checked the ring yet
+        m_parkLock.lock();
+        m_parkLock.unlock();
+
+        m_workAvailable.notify_one();
+    }
+
+    return true;
+}
+
+bool toccata::DecisionThread::DrainInput() {
+    if (m_input.IsEmpty()) return false;
+
+    // Cleared before the ring is emptied so that IsComplete can't report
+    // completion while a note is in flight
+    m_complete = false;
+
+    NoteEvent event;
+    while (m_input.Pop(&event)) {
+        MusicPoint point;
+        point.Timestamp = event.Timestamp;
+        point.Pitch = event.Pitch;
+        point.Length = event.Length;
+        point.Velocity = event.Velocity;
+
+        // Only the windows the new note falls into have to be matched again
+        const int index = m_inputBuffer.NoteContainer.AddPoint(point);
+        m_tree.OnNoteInserted(index);
+
+        m_dirty.Insert(index);
+        m_dirty.Add(m_tree.GetFirstDependentStart(index), index);
+    }
+
+    return true;
+}
+
+bool toccata::DecisionThread::Match(std::chrono::steady_clock::time_point start) {
+    if (!m_tree.IsPassPending()) {
+        // A backlog is matched several start indices at a time. Indices are
+        // only grouped if they are within a window of each other, which
+        // keeps the range of notes that cancel the pass small.
+        int indices[PipelineDepth];
+        indices[0] = m_dirty.Pop();
+
+        const int lastGrouped = m_tree.GetLastDependentIndex(indices[0]);
+
+        int count = 1;
+        while (count < PipelineDepth && !m_dirty.IsEmpty() && m_dirty.GetFirst() <= lastGrouped) {
+            indices[count++] = m_dirty.Pop();
+        }
+
+        m_tree.BeginPass(indices, count);
+    }
+
+    const int index = m_tree.GetPassStartIndex();
+    const MusicPointContainer &notes = m_inputBuffer.NoteContainer;
+    const int noteCount = notes.GetCount();
+    const int windowEnd = m_tree.GetLastDependentIndex(m_tree.GetLastPassStartIndex());
+
+    // A note is inserted before every note with the same or a later
+    // timestamp, so it falls inside the window exactly when it comes after
+    // the first note and not after the last one
+    m_cancel.Reset();
+    m_inFlightStart = notes.GetPoints()[index].Timestamp;
+    m_inFlightEnd = (windowEnd < noteCount)
+        ? notes.GetPoints()[windowEnd].Timestamp
+        : std::numeric_limits<timestamp>::max();
+    m_inFlight = true;
+
+    // Pairs with the fence in AddNote so that a note pushed before the
+    // bounds were visible is seen here instead
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Otherwise the pass is left pending until the new notes are drained,
+    // which moves it along with the input or abandons it
+    bool matched = false;
+    if (m_input.IsEmpty()) {
+        const std::chrono::steady_clock::time_point deadline = (m_iterationBudget > 0.0)
+            ? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(m_iterationBudget))
+            : std::chrono::steady_clock::time_point::max();
+
+        matched = m_tree.MatchSlice(deadline, &m_cancel);
+        RecordStageLatency(Stage::Match, start);
+
+        if (!matched) {
+            // Picked up again once the new notes have been drained
+            for (int startIndex : m_tree.GetPassStartIndices()) {
+                if (startIndex >= 0) m_dirty.Add(startIndex, startIndex);
+            }
+        }
+    }
+
+    m_inFlight = false;
+
+    return matched;
+}
+
+int toccata::DecisionThread::GetPendingIndex() const {
+    int index = m_dirty.IsEmpty()
+        ? m_inputBuffer.NoteContainer.GetCount()
+        : m_dirty.GetFirst();
+
+    if (m_tree.IsPassPending()) {
+        index = std::min(index, m_tree.GetPassStartIndex());
+    }
+
+    return index;
+}
+
 void toccata::DecisionThread::Clear() {
     m_bufferLock.lock();
 
     m_tree.Clear();
+    PublishSnapshot();
+
+    m_bufferLock.unlock();
+}
+
+std::vector<toccata::DecisionTree::MatchedPiece> toccata::DecisionThread::GetPieces() {
+    return m_snapshots.Read()->Pieces;
+}
+
+long long toccata::DecisionThread::GetSnapshotVersion() {
+    return m_snapshots.Read()->Version;
+}
+
+void toccata::DecisionThread::PublishSnapshot() {
+    const bool metricsRead = (m_metricsReadVersion == m_snapshotVersion);
+
+    Snapshot *snapshot = m_snapshots.BeginWrite();
+    snapshot->Version = ++m_snapshotVersion;
+    snapshot->Pieces = m_tree.GetPieces();
+
+    // Readers see indices relative to the start of the session
+    for (DecisionTree::MatchedPiece &piece : snapshot->Pieces) {
+        piece.Start += m_indexOffset;
+        piece.End += m_indexOffset;
+
+        for (DecisionTree::MatchedBar &bar : piece.Bars) {
+            bar.Start += m_indexOffset;
+            bar.End += m_indexOffset;
+        }
+    }
+
+    snapshot->PeakIndex = m_peakIndex;
+    snapshot->PeakTargetIndex = m_peakTargetIndex;
+    snapshot->PeakLatency = m_peakLatency;
+    snapshot->PeakWakeLatency = m_peakWakeLatencyReset ? 0.0 : m_peakWakeLatency;
+    snapshot->PeakActiveWorkers = m_peakActiveWorkers;
+
+    const DecisionTree::MatchCacheStatistics cacheStatistics = m_tree.GetMatchCacheStatistics();
+    snapshot->MatchCacheHitRate = cacheStatistics.GetHitRate();
+    snapshot->SavedSolveTime = cacheStatistics.SavedTime;
+
+    for (int i = 0; i < StageCount; ++i) {
+        snapshot->StageLatency[i] = m_stageLatency[i];
+    }
+
+    m_snapshots.Publish(snapshot);
+
+    // Peaks are carried over until a reader has seen them
+    if (metricsRead) {
+        m_peakIndexReset = true;
+        m_peakTargetIndexReset = true;
+        m_peakLatencyReset = true;
+        m_peakWakeLatencyReset = true;
+        m_stageLatencyReset = true;
+        m_peakActiveWorkersReset = true;
+    }
+
+    m_iterationsSincePublish = 0;
+}
+
+void toccata::DecisionThread::SetHorizon(int bars, double seconds) {
+    m_bufferLock.lock();
 
+    m_horizonBars = bars;
+    m_horizonSeconds = seconds;
+
+    m_bufferLock.unlock();
+}
+
+int toccata::DecisionThread::GetIndexOffset() {
+    m_bufferLock.lock();
+    const int indexOffset = m_indexOffset;
     m_bufferLock.unlock();
+
+    return indexOffset;
 }
 
-std::vector<toccata::DecisionTree::MatchedPiece> toccata::DecisionThread::GetPieces() {    
+void toccata::DecisionThread::ReadArchive(Archive *target) {
     m_bufferLock.lock();
 
-    std::vector<toccata::DecisionTree::MatchedPiece> result = m_tree.GetPieces();
+    target->Notes.insert(target->Notes.end(), m_archive.Notes.begin(), m_archive.Notes.end());
+    target->Pieces.insert(target->Pieces.end(), m_archive.Pieces.begin(), m_archive.Pieces.end());
+
+    m_archive.Notes.clear();
+    m_archive.Pieces.clear();
 
     m_bufferLock.unlock();
+}
+
+void toccata::DecisionThread::ApplyHorizon() {
+    if (m_horizonBars <= 0 && m_horizonSeconds <= 0) return;
+
+    const int noteCount = m_inputBuffer.NoteContainer.GetCount();
+    if (noteCount == 0) return;
 
-    return result;
+    int limit = -1;
+
+    if (m_horizonSeconds > 0) {
+        const MusicPoint *points = m_inputBuffer.NoteContainer.GetPoints();
+        const timestamp window =
+            (timestamp)(m_horizonSeconds * m_inputBuffer.PulseRate * m_inputBuffer.PulseUnit);
+        const timestamp oldest = points[noteCount - 1].Timestamp - window;
+
+        int cutoff = 0;
+        while (cutoff < noteCount && points[cutoff].Timestamp < oldest) ++cutoff;
+
+        limit = cutoff;
+    }
+
+    if (m_horizonBars > 0) {
+        const std::vector<DecisionTree::MatchedPiece> pieces = m_tree.GetPieces();
+
+        int cutoff = 0;
+        if (!pieces.empty()) {
+            const DecisionTree::MatchedPiece &newest = pieces.back();
+            const int barCount = (int)newest.Bars.size();
+
+            if (barCount > m_horizonBars) {
+                cutoff = newest.Bars[barCount - m_horizonBars].Start;
+            }
+        }
+
+        limit = (limit == -1)
+            ? cutoff
+            : std::min(limit, cutoff);
+    }
+
+    limit = std::min(limit, GetPendingIndex());
+    if (limit < HorizonBatch) return;
+
+    const int cutoff = m_tree.FindSafeCutoff(limit);
+    if (cutoff < HorizonBatch) return;
+
+    ArchivePieces(cutoff);
+
+    const MusicPoint *points = m_inputBuffer.NoteContainer.GetPoints();
+    m_archive.Notes.insert(m_archive.Notes.end(), points, points + cutoff);
+
+    m_tree.Retire(cutoff);
+    m_inputBuffer.NoteContainer.RemovePoints(0, cutoff);
+
+    m_dirty.Remove(cutoff);
+    m_indexOffset += cutoff;
+}
+
+void toccata::DecisionThread::ArchivePieces(int cutoff) {
+    // No decision straddles the cutoff, so every bar is either entirely
+    // archived or stays live
+    for (const DecisionTree::MatchedPiece &piece : m_tree.GetPieces()) {
+        DecisionTree::MatchedPiece archived;
+        archived.Piece = piece.Piece;
+        archived.Start = INT_MAX;
+        archived.End = INT_MIN;
+        archived.MatchedNotes = 0;
+
+        for (const DecisionTree::MatchedBar &bar : piece.Bars) {
+            if (bar.End >= cutoff) continue;
+
+            DecisionTree::MatchedBar archivedBar = bar;
+            archivedBar.Start += m_indexOffset;
+            archivedBar.End += m_indexOffset;
+
+            archived.Start = std::min(archived.Start, archivedBar.Start);
+            archived.End = std::max(archived.End, archivedBar.End);
+            archived.MatchedNotes += archivedBar.MatchedNotes;
+            archived.Bars.push_back(archivedBar);
+        }
+
+        if (!archived.Bars.empty()) {
+            m_archive.Pieces.push_back(archived);
+        }
+    }
 }
 
 void toccata::DecisionThread::RecordIndex(int index) {
@@ -121,16 +557,10 @@ void toccata::DecisionThread::RecordIndex(int index) {
 }
 
 int toccata::DecisionThread::ReadPeakIndex() {
-    int peakIndex;
-
-    m_bufferLock.lock();
-
-    m_peakIndexReset = true;
-    peakIndex = m_peakIndex;
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
 
-    m_bufferLock.unlock();
-
-    return peakIndex;
+    return snapshot->PeakIndex;
 }
 
 void toccata::DecisionThread::RecordTargetIndex(int index) {
@@ -144,16 +574,10 @@ void toccata::DecisionThread::RecordTargetIndex(int index) {
 }
 
 int toccata::DecisionThread::ReadPeakTargetIndex() {
-    int peakTargetIndex;
-
-    m_bufferLock.lock();
-
-    m_peakTargetIndexReset = true;
-    peakTargetIndex = m_peakTargetIndex;
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
 
-    m_bufferLock.unlock();
-
-    return m_peakTargetIndex;
+    return snapshot->PeakTargetIndex;
 }
 
 void toccata::DecisionThread::RecordLatency(double latency) {
@@ -167,14 +591,94 @@ void toccata::DecisionThread::RecordLatency(double latency) {
 }
 
 double toccata::DecisionThread::ReadPeakLatency() {
-    double peakLatency;
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
 
-    m_bufferLock.lock();
+    return snapshot->PeakLatency;
+}
 
-    m_peakLatencyReset = true;
-    peakLatency = m_peakLatency;
+void toccata::DecisionThread::RecordWakeLatency(double latency) {
+    if (m_peakWakeLatencyReset) {
+        m_peakWakeLatency = latency;
+        m_peakWakeLatencyReset = false;
+    }
+    else {
+        m_peakWakeLatency = std::max(m_peakWakeLatency, latency);
+    }
+}
 
-    m_bufferLock.unlock();
+double toccata::DecisionThread::ReadPeakWakeLatency() {
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
+
+    return snapshot->PeakWakeLatency;
+}
+
+void toccata::DecisionThread::RecordActiveWorkers(int workers) {
+    if (m_peakActiveWorkersReset) {
+        m_peakActiveWorkers = workers;
+        m_peakActiveWorkersReset = false;
+    }
+    else {
+        m_peakActiveWorkers = std::max(m_peakActiveWorkers, workers);
+    }
+}
+
+int toccata::DecisionThread::ReadPeakActiveWorkers() {
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
+
+    return snapshot->PeakActiveWorkers;
+}
+
+void toccata::DecisionThread::RecordStageLatency(Stage stage, std::chrono::steady_clock::time_point start) {
+    if (m_stageLatencyReset) {
+        for (LatencyHistogram &histogram : m_stageLatency) {
+            histogram.Clear();
+        }
+
+        m_stageLatencyReset = false;
+    }
+
+    const std::chrono::duration<double> latency = std::chrono::steady_clock::now() - start;
+    m_stageLatency[(int)stage].Record(latency.count());
+}
+
+toccata::LatencyHistogram toccata::DecisionThread::ReadStageLatency(Stage stage) {
+    SnapshotPublisher<Snapshot>::ReadGuard snapshot = m_snapshots.Read();
+    m_metricsReadVersion = snapshot->Version;
+
+    return snapshot->StageLatency[(int)stage];
+}
+
+double toccata::DecisionThread::ReadMatchCacheHitRate() {
+    return m_snapshots.Read()->MatchCacheHitRate;
+}
+
+double toccata::DecisionThread::ReadSavedSolveTime() {
+    return m_snapshots.Read()->SavedSolveTime;
+}
+
+double toccata::DecisionThread::ReadIdlePercentage() {
+    m_parkLock.lock();
+
+    const auto now = std::chrono::steady_clock::now();
+
+    // Include the part of an ongoing park that falls in this window
+    double idleTime = m_idleTime;
+    if (m_parked) {
+        const std::chrono::duration<double> idle = now - std::max(m_idleStart, m_idleWindowStart);
+        idleTime += idle.count();
+    }
+
+    const std::chrono::duration<double> window = now - m_idleWindowStart;
+
+    m_idleTime = 0.0;
+    m_idleWindowStart = now;
+
+    m_parkLock.unlock();
 
-    return peakLatency;
+    return (window.count() > 0)
+        ? 100.0 * idleTime / window.count()
+        : 0.0;
 }
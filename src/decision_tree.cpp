@@ -2,10 +2,44 @@
 
 #include "../include/memory.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+
 toccata::DecisionTree::DecisionTree() {
     m_library = nullptr;
     m_segment = nullptr;
     m_threadCount = 0;
+    m_activeThreadCount = 0;
+    m_requestedThreadCount = 0;
+    m_maxFootprint = 0;
+    m_nextSequence = 0;
+    m_firstInvalidEnd = INT_MAX;
+    m_piecesDirty = false;
+    m_matchCacheEnabled = true;
+    m_reverificationEnabled = true;
+    m_tempoTrackingEnabled = true;
+    m_tempoPriorEnabled = true;
+    m_deduplicationEnabled = true;
+    m_prefilterEnabled = true;
+    m_residency = nullptr;
+    m_inputTatum = 0.0;
+    m_retiredNotes = 0;
+    m_cancelledPasses = 0;
+    m_passPending = false;
+    m_passTaskCount = 0;
+    m_realtimeFailures = 0;
+
+    m_decisionQueries = 0;
+    m_visitedDecisions = 0;
+    m_followerEnabled = false;
+    m_following = false;
+    m_followerLockDepth = DefaultFollowerLockDepth;
+    m_followerLookahead = DefaultFollowerLookahead;
+    m_followerCheckInterval = DefaultFollowerCheckInterval;
+    m_passesSinceFullSearch = 0;
+    m_followedPasses = 0;
 }
 
 toccata::DecisionTree::~DecisionTree() {
@@ -13,23 +47,103 @@ toccata::DecisionTree::~DecisionTree() {
 }
 
 void toccata::DecisionTree::InvalidateAfter(int index) {
-    const int n = GetDecisionCount();
-    for (int i = 0; i < n; ++i) {
-        if (m_decisions[i]->GetEnd() >= index) {
-            m_decisions[i]->InvalidateCache();
-        }
+    m_piecesDirty = true;
+
+    auto begin = m_endIndex.lower_bound({ index, nullptr });
+    for (auto i = begin; i != m_endIndex.end(); ++i) {
+        InvalidateCache(i->second);
     }
 }
 
 void toccata::DecisionTree::OnNoteChange(int changedNote) {
-    const int decisionCount = GetDecisionCount();
-    int j = 0;
-    for (int i = 0; i < decisionCount; ++i) {
-        if (m_decisions[i]->GetEnd() >= changedNote) {
-            DeleteDecision(m_decisions[i]);
-            delete m_decisions[i];
+    std::vector<Decision *> dependents;
+    FindDependents(changedNote, false, &dependents);
+
+    RemoveDecisions(dependents);
+
+    if (m_passPending) {
+        const int windowLength = GetMaxWindowLength();
+        for (int &startIndex : m_passStartIndices) {
+            if (startIndex < 0) continue;
+
+            if (changedNote >= startIndex && changedNote < startIndex + windowLength) {
+                startIndex = -1;
+            }
         }
-        else {
+
+        UpdatePassPending();
+    }
+}
+
+void toccata::DecisionTree::OnNoteInserted(int index) {
+    std::vector<Decision *> dependents;
+    FindDependents(index, true, &dependents);
+
+    RemoveDecisions(dependents);
+    ShiftDecisions(index);
+
+    if (m_passPending) {
+        const int windowLength = GetMaxWindowLength();
+        for (int &startIndex : m_passStartIndices) {
+            if (startIndex < 0) continue;
+
+            if (index <= startIndex) ++startIndex;
+            else if (index < startIndex + windowLength) startIndex = -1;
+        }
+
+        UpdatePassPending();
+    }
+}
+
+int toccata::DecisionTree::GetFirstDependentStart(int index) const {
+    return std::max(0, index - GetMaxWindowLength() + 1);
+}
+
+int toccata::DecisionTree::GetLastDependentIndex(int startIndex) const {
+    return startIndex + GetMaxWindowLength() - 1;
+}
+
+void toccata::DecisionTree::FindDependents(int index, bool inserted, std::vector<Decision *> *target) const {
+    // A note inserted right at the start of a window only pushes the window
+    // along, so the match itself is still valid
+    const int windowLength = GetMaxWindowLength();
+
+    std::vector<Decision *> candidates;
+    FindDecisions(index - windowLength + 1, index + windowLength - 1, &candidates);
+
+    for (Decision *decision : candidates) {
+        const bool startsBefore = inserted
+            ? decision->WindowStart < index
+            : decision->WindowStart <= index;
+
+        if (startsBefore && decision->WindowEnd >= index) {
+            target->push_back(decision);
+        }
+    }
+}
+
+void toccata::DecisionTree::RemoveDecisions(const std::vector<Decision *> &decisions) {
+    if (decisions.empty()) return;
+
+    m_piecesDirty = true;
+
+    int firstIndex = GetDecisionCount();
+    for (Decision *decision : decisions) {
+        firstIndex = std::min(firstIndex, decision->Index);
+
+        RemoveFromIndex(decision);
+        DeleteDecision(decision);
+    }
+
+    for (Decision *decision : decisions) {
+        m_decisions[decision->Index] = nullptr;
+        DestroyDecision(decision);
+    }
+
+    const int decisionCount = GetDecisionCount();
+    int j = firstIndex;
+    for (int i = firstIndex; i < decisionCount; ++i) {
+        if (m_decisions[i] != nullptr) {
             m_decisions[j] = m_decisions[i];
             m_decisions[j]->Index = j;
 
@@ -40,8 +154,122 @@ void toccata::DecisionTree::OnNoteChange(int changedNote) {
     m_decisions.resize(j);
 }
 
+void toccata::DecisionTree::ShiftDecisions(int index) {
+    // Once the dependents are gone, every decision that ends at or after
+    // the inserted note also starts after it
+    auto begin = m_endIndex.lower_bound({ index, nullptr });
+    if (begin == m_endIndex.end()) return;
+
+    std::vector<Decision *> shifted;
+    for (auto i = begin; i != m_endIndex.end(); ++i) {
+        shifted.push_back(i->second);
+    }
+
+    m_endIndex.erase(begin, m_endIndex.end());
+
+    for (Decision *decision : shifted) {
+        assert(decision->WindowStart >= index);
+
+        for (int &note : decision->Notes) {
+            ++note;
+        }
+
+        ++decision->WindowStart;
+        ++decision->WindowEnd;
+
+        m_endIndex.insert({ decision->GetEnd(), decision });
+    }
+
+    InvalidateAfter(index);
+}
+
+int toccata::DecisionTree::FindSafeCutoff(int limit) const {
+    int cutoff = limit;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // Only decisions ending within a footprint of the cutoff can start
+        // before it
+        std::vector<Decision *> candidates;
+        FindDecisions(cutoff, cutoff + m_maxFootprint - 1, &candidates);
+
+        for (Decision *decision : candidates) {
+            if (decision->GetStart() < cutoff) {
+                cutoff = decision->GetStart();
+                changed = true;
+            }
+        }
+    }
+
+    return cutoff;
+}
+
+void toccata::DecisionTree::Retire(int cutoff) {
+    if (cutoff <= 0) return;
+
+    std::vector<Decision *> retired;
+    FindDecisions(INT_MIN, cutoff - 1, &retired);
+
+    for (Decision *decision : retired) {
+        DeleteDecision(decision);
+    }
+
+    for (Decision *decision : retired) {
+        m_decisions[decision->Index] = nullptr;
+        DestroyDecision(decision);
+    }
+
+    const int decisionCount = GetDecisionCount();
+    int j = 0;
+    for (int i = 0; i < decisionCount; ++i) {
+        Decision *decision = m_decisions[i];
+        if (decision == nullptr) continue;
+
+        assert(decision->GetStart() >= cutoff);
+
+        for (int &note : decision->Notes) {
+            note -= cutoff;
+        }
+
+        decision->WindowStart -= cutoff;
+        decision->WindowEnd -= cutoff;
+        decision->BranchStart -= cutoff;
+        decision->BranchEnd -= cutoff;
+
+        decision->Index = j;
+        m_decisions[j++] = decision;
+    }
+
+    m_decisions.resize(j);
+
+    m_endIndex.clear();
+    for (Decision *decision : m_decisions) {
+        m_endIndex.insert({ decision->GetEnd(), decision });
+    }
+
+    if (m_firstInvalidEnd != INT_MAX) {
+        m_firstInvalidEnd = std::max(0, m_firstInvalidEnd - cutoff);
+    }
+
+    m_retiredNotes += cutoff;
+    m_piecesDirty = true;
+
+    if (m_passPending) {
+        for (int &startIndex : m_passStartIndices) {
+            if (startIndex < 0) continue;
+            startIndex = std::max(startIndex - cutoff, -1);
+        }
+
+        UpdatePassPending();
+    }
+}
+
 void toccata::DecisionTree::Initialize(int threadCount) {
     m_threadCount = threadCount;
+    m_activeThreadCount = threadCount;
+    m_requestedThreadCount = threadCount;
     m_threadContexts = Memory::Allocate<ThreadContext>(m_threadCount);
 
     for (int i = 0; i < m_threadCount; ++i) {
@@ -50,6 +278,12 @@ void toccata::DecisionTree::Initialize(int threadCount) {
 }
 
 void toccata::DecisionTree::SpawnThreads() {
+    if (m_realtimeSettings.Enabled && m_realtimeSettings.LockMemory) {
+        for (int i = 0; i < m_threadCount; ++i) {
+            if (!m_threadContexts[i].Solver.LockMemory()) ++m_realtimeFailures;
+        }
+    }
+
     if (m_threadCount > 1 || ForceMultithreaded) {
         for (int i = 0; i < m_threadCount; ++i) {
             m_threadContexts[i].Thread = new std::thread(&DecisionTree::WorkerThread, this, i);
@@ -60,11 +294,18 @@ void toccata::DecisionTree::SpawnThreads() {
     }
 }
 
+void toccata::DecisionTree::SetActiveThreadCount(int count) {
+    m_requestedThreadCount = std::max(1, std::min(count, m_threadCount));
+}
+
 void toccata::DecisionTree::KillThreads() {
     for (int i = 0; i < m_threadCount; ++i) {
         m_threadContexts[i].Kill = true;
     }
 
+    // Parked workers have to be woken up as well
+    m_activeThreadCount = m_threadCount;
+
     TriggerThreads();
 
     if (m_threadCount > 1 || ForceMultithreaded) {
@@ -91,40 +332,446 @@ void toccata::DecisionTree::Destroy() {
     m_threadContexts = nullptr;
 }
 
-void toccata::DecisionTree::Process(int startIndex) {
+bool toccata::DecisionTree::Process(int startIndex, const CancellationToken *token) {
+    BeginPass(startIndex);
+
+    return ContinuePass(std::chrono::steady_clock::time_point::max(), token)
+        == PassStatus::Complete;
+}
+
+void toccata::DecisionTree::BeginPass(const int *startIndices, int count) {
+    assert(count > 0);
+
+    m_passPending = true;
+    m_passStartIndices.assign(startIndices, startIndices + count);
+    m_activeThreadCount = m_requestedThreadCount;
+
+    // Orders are kept between passes so that their storage is reused
+    if ((int)m_barOrders.size() < count) {
+        m_barOrders.resize(count);
+    }
+
+    // Start indices without a locked piece nearby fall back to the whole
+    // library, so orders can differ in length
+    const bool follow = m_followerEnabled && m_passesSinceFullSearch < m_followerCheckInterval;
+
+    m_following = follow;
+    int longestOrder = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!follow || !FollowBars(startIndices[i], &m_barOrders[i])) {
+            PrioritizeBars(startIndices[i], &m_barOrders[i]);
+            m_following = false;
+        }
+
+        if (m_deduplicationEnabled) CanonicalizeBars(&m_barOrders[i]);
+
+        longestOrder = std::max(longestOrder, (int)m_barOrders[i].size());
+    }
+
+    if (m_following) {
+        ++m_passesSinceFullSearch;
+        ++m_followedPasses;
+    }
+    else {
+        m_passesSinceFullSearch = 0;
+    }
+
+    m_passTaskCount = count * longestOrder;
+
+    UpdateTatums();
+    UpdateWindowPitches();
+    PrefetchSuccessors();
+    TrimMatchCache();
+
+    // Workers that aren't active start out of tasks. Candidates left over
+    // from a cancelled pass are dropped.
+    for (int i = 0; i < m_threadCount; ++i) {
+        m_threadContexts[i].TaskCursor = (i < m_activeThreadCount) ? i : m_passTaskCount;
+        m_threadContexts[i].CandidateCount = 0;
+    }
+}
+
+int toccata::DecisionTree::GetPassStartIndex() const {
+    for (int startIndex : m_passStartIndices) {
+        if (startIndex >= 0) return startIndex;
+    }
+
+    return -1;
+}
+
+int toccata::DecisionTree::GetLastPassStartIndex() const {
+    for (auto i = m_passStartIndices.rbegin(); i != m_passStartIndices.rend(); ++i) {
+        if (*i >= 0) return *i;
+    }
+
+    return -1;
+}
+
+void toccata::DecisionTree::UpdatePassPending() {
+    if (GetPassStartIndex() < 0) AbandonPass();
+}
+
+toccata::DecisionTree::PassStatus toccata::DecisionTree::ContinuePass(
+    std::chrono::steady_clock::time_point deadline,
+    const CancellationToken *token)
+{
+    if (!MatchSlice(deadline, token)) return PassStatus::Cancelled;
+
+    return IntegrateSlice();
+}
+
+bool toccata::DecisionTree::MatchSlice(
+    std::chrono::steady_clock::time_point deadline,
+    const CancellationToken *token)
+{
+    assert(m_passPending);
+
     for (int i = 0; i < m_threadCount; ++i) {
-        m_threadContexts[i].StartIndex = startIndex;
+        m_threadContexts[i].Token = token;
+        m_threadContexts[i].Deadline = deadline;
     }
 
+    // Workers read the branch tempos when predicting, so they have to be
+    // brought up to date before the workers start
+    UpdateBranches();
+
     DistributeWork();
     TriggerThreads();
     WaitForThreads();
 
+    // Candidates from a cancelled pass may have been matched against input
+    // that has changed since, so none of them are merged
+    if (token != nullptr && token->IsCancelled()) {
+        ++m_cancelledPasses;
+        AbandonPass();
+
+        return false;
+    }
+
+    return true;
+}
+
+toccata::DecisionTree::PassStatus toccata::DecisionTree::IntegrateSlice() {
     Integrate();
+
+    for (int i = 0; i < m_threadCount; ++i) {
+        if (m_threadContexts[i].TaskCursor < m_passTaskCount) {
+            return PassStatus::Partial;
+        }
+    }
+
+    m_passPending = false;
+
+    return PassStatus::Complete;
 }
 
-void toccata::DecisionTree::DistributeWork() {
-    if (m_library != nullptr) {
-        int libraryStart = 0;
-        const int libraryBars = m_library->GetBarCount();
-        const int libraryDelta = (int)std::ceil(libraryBars / (double)m_threadCount);
-        for (int i = 0; i < m_threadCount; ++i) {
-            int end = libraryStart + libraryDelta - 1;
-            if (end >= libraryBars) end = libraryBars - 1;
+void toccata::DecisionTree::PrioritizeBars(int startIndex, std::vector<int> *order) {
+    order->clear();
+    if (m_library == nullptr) return;
+
+    const int barCount = m_library->GetBarCount();
+    m_matchCache.SetBarCount(barCount);
+    if ((int)m_barQueued.size() != barCount) {
+        m_barQueued.assign(barCount, false);
+    }
+
+    auto queue = [this, order](const Bar *bar) {
+        const int barIndex = bar->GetId();
+        if (!m_barQueued[barIndex]) {
+            m_barQueued[barIndex] = true;
+            order->push_back(barIndex);
+        }
+    };
 
-            m_threadContexts[i].LibraryStart = libraryStart;
-            m_threadContexts[i].LibraryEnd = end;
+    const int windowLength = GetMaxWindowLength();
 
-            libraryStart = end + 1;
+    m_recentDecisions.clear();
+    m_recentPieces.clear();
+    FindDecisions(startIndex - windowLength, startIndex + windowLength - 1, &m_recentDecisions);
+
+    // The bar after the match that ended last is the likeliest to start
+    // around this index
+    std::stable_sort(m_recentDecisions.begin(), m_recentDecisions.end(),
+        [](const Decision *a, const Decision *b) {
+            return a->GetEnd() > b->GetEnd();
+        });
+
+    for (const Decision *decision : m_recentDecisions) {
+        const int nextCount = decision->MatchedBar->GetNextCount();
+        for (int i = 0; i < nextCount; ++i) {
+            queue(decision->MatchedBar->GetNext(i));
         }
     }
-    else {
-        for (int i = 0; i < m_threadCount; ++i) {
-            m_threadContexts[i].LibraryStart = 0;
-            m_threadContexts[i].LibraryEnd = -1;
+
+    for (const Decision *decision : m_recentDecisions) {
+        queue(decision->MatchedBar);
+
+        const Piece *piece = decision->MatchedBar->GetPiece();
+        if (std::find(m_recentPieces.begin(), m_recentPieces.end(), piece) == m_recentPieces.end()) {
+            m_recentPieces.push_back(piece);
+        }
+    }
+
+    if (!m_recentPieces.empty()) {
+        for (int i = 0; i < barCount; ++i) {
+            const Bar *bar = m_library->GetBar(i);
+            if (std::find(m_recentPieces.begin(), m_recentPieces.end(), bar->GetPiece()) != m_recentPieces.end()) {
+                queue(bar);
+            }
+        }
+    }
+
+    for (int i = 0; i < barCount; ++i) {
+        queue(m_library->GetBar(i));
+    }
+
+    m_barQueued.assign(barCount, false);
+}
+
+void toccata::DecisionTree::CanonicalizeBars(std::vector<int> *order) {
+    // Each group is matched where its first bar was queued. Flags are all
+    // cleared between calls, see PrioritizeBars.
+    size_t j = 0;
+    for (size_t i = 0; i < order->size(); ++i) {
+        const int canonical = m_library->GetBar((*order)[i])->GetCanonical()->GetId();
+        if (!m_barQueued[canonical]) {
+            m_barQueued[canonical] = true;
+            (*order)[j++] = canonical;
         }
     }
 
+    order->resize(j);
+
+    for (int barIndex : *order) {
+        m_barQueued[barIndex] = false;
+    }
+}
+
+void toccata::DecisionTree::ShareMatch(const Bar *bar, ThreadContext &context) {
+    const int duplicateCount = bar->GetDuplicateCount();
+    if (duplicateCount == 0) return;
+
+    const int matched = context.CandidateCount - 1;
+    if (context.CandidateCount + duplicateCount > (int)context.Candidates.size()) {
+        context.Candidates.resize((size_t)context.CandidateCount + duplicateCount);
+    }
+
+    // Duplicates share the canonical bar's segment, so the match holds
+    // for each of them as is
+    for (int i = 0; i < duplicateCount; ++i) {
+        Decision &copy = context.Candidates[context.CandidateCount++];
+        copy = context.Candidates[matched];
+        copy.MatchedBar = bar->GetDuplicate(i);
+    }
+
+    context.SharedMatches += duplicateCount;
+}
+
+bool toccata::DecisionTree::IsReachable(const Bar *from, const Bar *reference) const {
+    if (from->FindNext(reference, 1).Offset != -1) return true;
+    else if (!m_deduplicationEnabled) return false;
+
+    // Only canonical bars are matched, on behalf of their whole group
+    for (int i = 0; i < reference->GetDuplicateCount(); ++i) {
+        if (from->FindNext(reference->GetDuplicate(i), 1).Offset != -1) return true;
+    }
+
+    return false;
+}
+
+bool toccata::DecisionTree::FollowBars(int startIndex, std::vector<int> *order) {
+    order->clear();
+    if (m_library == nullptr) return false;
+
+    const int barCount = m_library->GetBarCount();
+    m_matchCache.SetBarCount(barCount);
+    if ((int)m_barQueued.size() != barCount) {
+        m_barQueued.assign(barCount, false);
+    }
+
+    const int windowLength = GetMaxWindowLength();
+
+    m_recentDecisions.clear();
+    FindDecisions(startIndex - windowLength, startIndex + windowLength - 1, &m_recentDecisions);
+
+    // Bars that don't belong to a piece are all followed together
+    bool isLocked = false;
+    const Piece *locked = nullptr;
+    for (Decision *decision : m_recentDecisions) {
+        if (GetDepth(decision) >= m_followerLockDepth) {
+            isLocked = true;
+            locked = decision->MatchedBar->GetPiece();
+            break;
+        }
+    }
+
+    if (!isLocked) return false;
+
+    std::stable_sort(m_recentDecisions.begin(), m_recentDecisions.end(),
+        [](const Decision *a, const Decision *b) {
+            return a->GetEnd() > b->GetEnd();
+        });
+
+    auto queue = [this, order](const Bar *bar) {
+        const int barIndex = bar->GetId();
+        if (!m_barQueued[barIndex]) {
+            m_barQueued[barIndex] = true;
+            order->push_back(barIndex);
+        }
+    };
+
+    // Nearest successors first, then the bars themselves in case a bar is
+    // repeated, then the successors further ahead in case bars are skipped
+    m_followFrontier.clear();
+    for (const Decision *decision : m_recentDecisions) {
+        if (decision->MatchedBar->GetPiece() == locked) {
+            m_followFrontier.push_back(decision->MatchedBar);
+        }
+    }
+
+    const size_t matchedBars = m_followFrontier.size();
+    size_t levelStart = 0;
+    for (int step = 0; step < m_followerLookahead; ++step) {
+        const size_t levelEnd = m_followFrontier.size();
+        for (size_t i = levelStart; i < levelEnd; ++i) {
+            const Bar *bar = m_followFrontier[i];
+            const int nextCount = bar->GetNextCount();
+            for (int j = 0; j < nextCount; ++j) {
+                const Bar *next = bar->GetNext(j);
+                if (m_barQueued[next->GetId()]) continue;
+
+                queue(next);
+                m_followFrontier.push_back(next);
+            }
+        }
+
+        levelStart = levelEnd;
+
+        if (step == 0) {
+            for (size_t i = 0; i < matchedBars; ++i) {
+                queue(m_followFrontier[i]);
+            }
+        }
+    }
+
+    // Only the queued entries are cleared so that following doesn't scale
+    // with the size of the library. PrioritizeBars leaves every flag
+    // cleared as well.
+    for (int barIndex : *order) {
+        m_barQueued[barIndex] = false;
+    }
+
+    return !order->empty();
+}
+
+void toccata::DecisionTree::UpdateTatums() {
+    m_inputTatum = 0.0;
+    if (!m_tempoPriorEnabled || m_library == nullptr) return;
+
+    // Bars don't change once they are in the library
+    const int barCount = m_library->GetBarCount();
+    if ((int)m_barTatums.size() != barCount) {
+        m_barTatums.resize(barCount);
+
+        for (int i = 0; i < barCount; ++i) {
+            const Bar *bar = m_library->GetBar(i);
+            const Bar::Summary &summary = bar->GetSummary();
+
+            // Summaries spare reading the notes of every bar
+            TempoEstimator::Estimate estimate;
+            if (summary.Valid) {
+                estimate.Valid = summary.Tatum > 0.0;
+                estimate.Tatum = summary.Tatum;
+                estimate.Confidence = summary.TatumConfidence;
+            }
+            else {
+                const MusicSegment *segment = bar->GetSegment();
+                estimate = m_tempoEstimator.EstimateTatum(
+                    segment, 0, segment->NoteContainer.GetCount() - 1);
+            }
+
+            m_barTatums[bar->GetId()] = (estimate.Valid && estimate.Confidence >= MinimumTatumConfidence)
+                ? estimate.Tatum
+                : 0.0;
+        }
+    }
+
+    const TempoEstimator::Estimate estimate = m_tempoEstimator.EstimateTatum(
+        m_segment,
+        GetPassStartIndex() - TatumEstimateNotes,
+        GetLastPassStartIndex() + TatumEstimateNotes);
+    if (estimate.Valid && estimate.Confidence >= MinimumTatumConfidence) {
+        m_inputTatum = estimate.Tatum;
+    }
+}
+
+void toccata::DecisionTree::UpdateWindowPitches() {
+    if (!m_prefilterEnabled || m_library == nullptr) return;
+
+    const int slotCount = (int)m_passStartIndices.size();
+    m_windowPitches.assign((size_t)slotCount * Library::MaxPitches, 0);
+
+    // Every bar's window fits in the widest one, so its counts bound what
+    // any of them can map
+    const int windowLength = GetMaxWindowLength();
+    const int k = m_segment->NoteContainer.GetCount();
+    const MusicPoint *points = m_segment->NoteContainer.GetPoints();
+    for (int slot = 0; slot < slotCount; ++slot) {
+        const int startIndex = m_passStartIndices[slot];
+        if (startIndex < 0) continue;
+
+        int *counts = &m_windowPitches[(size_t)slot * Library::MaxPitches];
+        const int end = std::min(startIndex + windowLength, k);
+        for (int i = startIndex; i < end; ++i) {
+            if (points[i].Pitch < Library::MaxPitches) ++counts[points[i].Pitch];
+        }
+    }
+}
+
+bool toccata::DecisionTree::MayMatch(const Bar *bar, int slot) const {
+    const Bar::Summary &summary = bar->GetSummary();
+    if (!m_prefilterEnabled || !summary.Valid) return true;
+
+    // Notes are only ever mapped to notes of the same pitch, one to one
+    const int *counts = &m_windowPitches[(size_t)slot * Library::MaxPitches];
+    int n = 0;
+    int mappable = 0;
+    for (const Bar::PitchCount &pitch : summary.Pitches) {
+        n += pitch.Count;
+        mappable += std::min((int)pitch.Count, counts[pitch.Pitch]);
+    }
+
+    if (n == 0) return true;
+
+    return (n - mappable) / (double)n <= MissingNoteThreshold;
+}
+
+void toccata::DecisionTree::PrefetchSuccessors() {
+    if (m_residency == nullptr || m_library == nullptr) return;
+
+    const int windowLength = GetMaxWindowLength();
+
+    m_recentDecisions.clear();
+    FindDecisions(
+        GetPassStartIndex() - windowLength,
+        GetLastPassStartIndex() + windowLength - 1,
+        &m_recentDecisions);
+
+    for (const Decision *decision : m_recentDecisions) {
+        const Bar *bar = decision->MatchedBar;
+        for (int i = 0; i < bar->GetNextCount(); ++i) {
+            m_residency->Prefetch(bar->GetNext(i));
+        }
+    }
+}
+
+void toccata::DecisionTree::SetFollowerParameters(int lockDepth, int lookahead, int checkInterval) {
+    m_followerLockDepth = std::max(1, lockDepth);
+    m_followerLookahead = std::max(1, lookahead);
+    m_followerCheckInterval = std::max(0, checkInterval);
+}
+
+void toccata::DecisionTree::DistributeWork() {
     int decisionStart = 0;
     const int decisionCount = GetDecisionCount();
     const int decisionDelta = (int)std::ceil(decisionCount / (double)m_threadCount);
@@ -139,12 +786,20 @@ void toccata::DecisionTree::DistributeWork() {
     }
 }
 
+bool toccata::DecisionTree::IsRunningInline() const {
+    // A single active worker runs on the calling thread, which saves a
+    // round trip through the worker's condition variable
+    return m_activeThreadCount == 1 && !ForceMultithreaded;
+}
+
 void toccata::DecisionTree::TriggerThreads() {
-    if (m_threadCount == 1 && !ForceMultithreaded) {
-        Work(0, m_threadContexts[0]);
+    if (IsRunningInline()) {
+        if (!m_threadContexts[0].Kill) {
+            Work(0, m_threadContexts[0]);
+        }
     }
     else {
-        for (int i = 0; i < m_threadCount; ++i) {
+        for (int i = 0; i < m_activeThreadCount; ++i) {
             std::lock_guard<std::mutex> lk(m_threadContexts[i].Lock);
             m_threadContexts[i].Trigger = true;
             m_threadContexts[i].ConditionVariable.notify_one();
@@ -153,11 +808,11 @@ void toccata::DecisionTree::TriggerThreads() {
 }
 
 void toccata::DecisionTree::WaitForThreads() {
-    if (m_threadCount == 1 && !ForceMultithreaded) {
+    if (IsRunningInline()) {
         return;
     }
 
-    for (int i = 0; i < m_threadCount; ++i) {
+    for (int i = 0; i < m_activeThreadCount; ++i) {
         std::unique_lock<std::mutex> lk(m_threadContexts[i].Lock);
         m_threadContexts[i].ConditionVariable
             .wait(lk, [this, i] { return m_threadContexts[i].Done; });
@@ -167,339 +822,433 @@ void toccata::DecisionTree::WaitForThreads() {
 }
 
 void toccata::DecisionTree::Integrate() {
+    m_mergeOrder.clear();
     for (int i = 0; i < m_threadCount; ++i) {
-        std::queue<Decision *> &newDecisions = m_threadContexts[i].NewDecisions;
+        ThreadContext &context = m_threadContexts[i];
 
-        while (!newDecisions.empty()) {
-            Decision *decision = newDecisions.front(); newDecisions.pop();
+        for (int j = 0; j < context.CandidateCount; ++j) {
+            Decision *candidate = &context.Candidates[j];
+            m_mergeOrder.push_back(
+                { candidate->WindowStart, candidate->MatchedBar->GetId(), candidate, context.SameDecisions[j] });
+        }
+
+        context.CandidateCount = 0;
+    }
+
+    // Candidates for one start index all match different bars, so the
+    // workers' verdicts can't be affected by the order of the merge. With
+    // several start indices, a bar merged at an earlier index can change
+    // the verdict for the same bar at a later one.
+    const bool pipelined = m_passStartIndices.size() > 1;
+    if (pipelined) {
+        std::sort(m_mergeOrder.begin(), m_mergeOrder.end(),
+            [](const MergeEntry &a, const MergeEntry &b) {
+                return (a.StartIndex != b.StartIndex)
+                    ? a.StartIndex < b.StartIndex
+                    : a.BarIndex < b.BarIndex;
+            });
+
+        m_barMerged.assign(m_barQueued.size(), false);
+    }
 
-            if (!IntegrateDecision(decision)) {
-                DestroyDecision(decision);
+    for (const MergeEntry &entry : m_mergeOrder) {
+        Decision *same = entry.Same;
+
+        if (pipelined) {
+            if (m_barMerged[entry.BarIndex]) {
+                same = FindSameDecision(entry.Candidate, &m_mergeScratch);
             }
+
+            m_barMerged[entry.BarIndex] = true;
+        }
+
+        if (same == nullptr) {
+            InsertDecision(entry.Candidate);
+        }
+        else if (entry.Candidate->IsBetterFitThan(same)) {
+            UpdateDecision(same, entry.Candidate);
+        }
+        else {
+            // The decision was matched again even though it's kept as is
+            same->ReverifiedStreak = entry.Candidate->ReverifiedStreak;
         }
     }
 }
 
 void toccata::DecisionTree::UpdateDecision(Decision *target, Decision *source) {
-    target->AverageError = source->AverageError;
-    target->MappedNotes = source->MappedNotes;
-    target->Notes = source->Notes;
-    target->T = source->T;
-    target->MatchedBar = source->MatchedBar;
-    target->Singular = source->Singular;
+    RemoveFromIndex(target);
+    CopyMatch(target, source);
+    AddToIndex(target);
 
     InvalidateAfter(target->GetEnd());
     UpdateOverlapMatrix(target);
 }
 
 void toccata::DecisionTree::DeleteDecision(Decision *decision) {
-    CleanOverlapMatrix(decision);
+    m_piecesDirty = true;
 
-    for (Decision *d : m_decisions) {
-        if (d->ParentDecision == decision) {
-            d->InvalidateCache();
-        }
-    }
+    CleanOverlapMatrix(decision);
+    InvalidateCache(decision);
 }
 
 void toccata::DecisionTree::UpdateOverlapMatrix(Decision *d0) {
     CleanOverlapMatrix(d0);
 
-    for (Decision *d1 : m_decisions) {
+    std::vector<Decision *> candidates;
+    FindOverlapping(d0, &candidates);
+
+    for (Decision *d1 : candidates) {
         if (d0 == d1) continue;
 
         const int minNoteCount = std::min(d0->MappedNotes, d1->MappedNotes);
         const int overlap = (int)std::ceil(0.5 * minNoteCount);
 
         if (d0->Overlapping(d1, overlap)) {
-            d0->OverlappingDecisions.push_back(d1);
-            d1->OverlappingDecisions.push_back(d0);
+            d0->OverlappingDecisions.Add(d1->Handle);
+            d1->OverlappingDecisions.Add(d0->Handle);
         }
     }
 }
 
 void toccata::DecisionTree::CleanOverlapMatrix(Decision *decision) {
-    for (Decision *overlap : decision->OverlappingDecisions) {
-        for (auto i = overlap->OverlappingDecisions.begin();
-            i != overlap->OverlappingDecisions.end(); ++i) 
-        {
-            if (*i == decision) {
-                overlap->OverlappingDecisions.erase(i);
-                break;
-            }
+    for (const ObjectHandle &handle : decision->OverlappingDecisions) {
+        Decision *overlap = m_decisionPool.Resolve(handle);
+        overlap->OverlappingDecisions.Remove(
+            overlap->OverlappingDecisions.Find(decision->Handle));
+    }
+
+    decision->OverlappingDecisions.Clear();
+}
+
+int toccata::DecisionTree::GetDepth(Decision *decision) {
+    if (!IsCached(decision)) {
+        UpdateBranches();
+    }
+
+    return decision->Depth;
+}
+
+void toccata::DecisionTree::UpdateBranches() {
+    if (m_firstInvalidEnd == INT_MAX) return;
+
+    // A parent always ends before its child, so visiting decisions in order
+    // of their end index guarantees that every candidate parent is already
+    // up to date. Everything ending before m_firstInvalidEnd is still valid.
+    auto begin = m_endIndex.lower_bound({ m_firstInvalidEnd, nullptr });
+    for (auto i = begin; i != m_endIndex.end(); ++i) {
+        if (!IsCached(i->second)) {
+            UpdateBranch(i->second);
         }
     }
 
-    decision->OverlappingDecisions.clear();
+    m_firstInvalidEnd = INT_MAX;
 }
 
-int toccata::DecisionTree::GetDepth(Decision *decision) const {
-    if (!decision->IsCached()) {
-        Decision *bestParent = FindBestParent(decision);
+void toccata::DecisionTree::UpdateBranch(Decision *decision) {
+    Decision *bestParent = FindBestParent(decision);
+
+    if (bestParent != nullptr) {
+        decision->ParentDecision = bestParent->Handle;
+        decision->Depth = 1 + bestParent->Depth;
+        decision->BranchNoteCount = decision->MappedNotes + bestParent->BranchNoteCount;
+        decision->BranchStart = std::min(decision->GetStart(), bestParent->BranchStart);
+        decision->BranchEnd = std::max(decision->GetEnd(), bestParent->BranchEnd);
 
-        if (bestParent != nullptr) {
-            decision->ParentDecision = bestParent;
-            decision->Depth = 1 + GetDepth(bestParent);
+        bestParent->Children.Add(decision->Handle);
+    }
+    else {
+        decision->ParentDecision = ObjectHandle();
+        decision->Depth = 1;
+        decision->BranchNoteCount = decision->MappedNotes;
+        decision->BranchStart = decision->GetStart();
+        decision->BranchEnd = decision->GetEnd();
+    }
+
+    // The tempo is carried over from the parent's bar to this one and
+    // corrected with where this bar was actually found
+    const Transform &T = decision->T;
+    if (T.s <= 0.0) {
+        decision->Tempo.Reset();
+    }
+    else {
+        const double boundary = m_segment->Normalize(T.t_coarse) + T.inv_f(0.0);
+        const double period = 1.0 / T.s;
+
+        if (bestParent != nullptr && bestParent->Tempo.IsValid()) {
+            decision->Tempo = bestParent->Tempo;
+            decision->Tempo.Predict(bestParent->MatchedBar->GetSegment()->GetNormalizedLength());
+            decision->Tempo.Update(boundary, period);
         }
         else {
-            decision->ParentDecision = nullptr;
-            decision->Depth = 1;
+            decision->Tempo.Initialize(boundary, period);
         }
-
-        decision->Cached = true;
     }
 
-    return decision->Depth;
+    decision->Cached = true;
 }
 
-int toccata::DecisionTree::GetBranchNoteCount(Decision *decision) const {
-    if (!decision->IsCached()) {
-        GetDepth(decision);
-    }
+int toccata::DecisionTree::GetBranchNoteCount(Decision *decision) {
+    GetDepth(decision);
+    return decision->BranchNoteCount;
+}
 
-    int noteCount = 0;
+double toccata::DecisionTree::GetBranchAverageError(Decision *decision) {
+    const int depth = GetDepth(decision);
 
-    Decision *i = decision;
-    while (i != nullptr) {
-        noteCount += i->MappedNotes;
-        i = i->ParentDecision;
+    double totalError = 0;
+
+    for (Decision *i = decision; i != nullptr; i = GetParent(i)) {
+        totalError += i->AverageError;
     }
 
-    return noteCount;
+    return totalError / depth;
 }
 
-double toccata::DecisionTree::GetBranchAverageError(Decision *decision) const {
-    const int depth = GetDepth(decision);
+int toccata::DecisionTree::GetBranchStart(Decision *decision) {
+    GetDepth(decision);
+    return decision->BranchStart;
+}
+
+int toccata::DecisionTree::GetBranchEnd(Decision *decision) {
+    GetDepth(decision);
+    return decision->BranchEnd;
+}
+
+toccata::DecisionTree::AllocationStatistics toccata::DecisionTree::GetAllocationStatistics() const {
+    AllocationStatistics statistics;
+    statistics.DecisionAllocations = m_decisionPool.GetAllocationCount();
+    statistics.SlabAllocations = m_decisionPool.GetSlabAllocationCount();
+    statistics.LiveDecisions = m_decisionPool.GetLiveCount();
+    statistics.PoolCapacity = m_decisionPool.GetCapacity();
 
-    double totalError = 0;
+    return statistics;
+}
 
-    Decision *i = decision;
-    while (i->ParentDecision != nullptr) {
-        totalError += i->AverageError;
-    }
+toccata::DecisionTree::QueryStatistics toccata::DecisionTree::GetQueryStatistics() const {
+    QueryStatistics statistics;
+    statistics.Queries = m_decisionQueries;
+    statistics.VisitedDecisions = m_visitedDecisions;
 
-    return totalError / depth;
+    return statistics;
 }
 
-int toccata::DecisionTree::GetBranchStart(Decision *decision) const {
-    int start = INT_MAX;
+toccata::DecisionTree::MatchCacheStatistics toccata::DecisionTree::GetMatchCacheStatistics() const {
+    MatchCacheStatistics statistics;
+    statistics.Hits = 0;
+    statistics.Misses = 0;
+    statistics.SolveTime = 0.0;
 
-    if (!decision->IsCached()) {
-        GetDepth(decision);
+    for (int i = 0; i < m_threadCount; ++i) {
+        statistics.Hits += m_threadContexts[i].CacheHits;
+        statistics.Misses += m_threadContexts[i].CacheMisses;
+        statistics.SolveTime += m_threadContexts[i].SolveTime;
     }
 
-    Decision *i = decision;
-    while (i->ParentDecision != nullptr) {
-        start = std::min(start, i->GetStart());
-    }
+    statistics.SavedTime = (statistics.Misses > 0)
+        ? statistics.Hits * (statistics.SolveTime / statistics.Misses)
+        : 0.0;
 
-    return start;
-}
+    statistics.Tables = m_matchCache.GetTableCount();
 
-int toccata::DecisionTree::GetBranchEnd(Decision *decision) {
-    int end = INT_MIN;
+    return statistics;
+}
 
-    if (!decision->IsCached()) {
-        GetDepth(decision);
-    }
+toccata::DecisionTree::SolverStatistics toccata::DecisionTree::GetSolverStatistics() const {
+    SolverStatistics statistics;
+    statistics.FullSolves = 0;
+    statistics.Reverified = 0;
+    statistics.ReverificationAttempts = 0;
+    statistics.ReverificationRefreshes = 0;
+    statistics.CancelledPasses = m_cancelledPasses;
+    statistics.FollowedPasses = m_followedPasses;
+    statistics.PredictionAttempts = 0;
+    statistics.Predicted = 0;
+    statistics.EvaluatedHypotheses = 0;
+    statistics.SharedMatches = 0;
+    statistics.Prefiltered = 0;
 
-    Decision *i = decision;
-    while (i->ParentDecision != nullptr) {
-        end = std::max(end, i->GetStart());
+    for (int i = 0; i < m_threadCount; ++i) {
+        statistics.FullSolves += m_threadContexts[i].FullSolves;
+        statistics.Reverified += m_threadContexts[i].Reverified;
+        statistics.ReverificationAttempts += m_threadContexts[i].ReverificationAttempts;
+        statistics.ReverificationRefreshes += m_threadContexts[i].ReverificationRefreshes;
+        statistics.PredictionAttempts += m_threadContexts[i].PredictionAttempts;
+        statistics.Predicted += m_threadContexts[i].Predicted;
+        statistics.EvaluatedHypotheses += m_threadContexts[i].Solver.GetEvaluatedHypotheses();
+        statistics.SharedMatches += m_threadContexts[i].SharedMatches;
+        statistics.Prefiltered += m_threadContexts[i].Prefiltered;
     }
 
-    return end;
+    return statistics;
 }
 
 void toccata::DecisionTree::Clear() {
     for (Decision *decision : m_decisions) {
-        delete decision;
+        DestroyDecision(decision);
     }
 
     m_decisions.clear();
+    m_endIndex.clear();
+    m_maxFootprint = 0;
+    m_firstInvalidEnd = INT_MAX;
+
+    m_pieces.clear();
+    m_piecesDirty = false;
+
+    AbandonPass();
 }
 
 std::vector<toccata::DecisionTree::MatchedPiece> toccata::DecisionTree::GetPieces() {
-    const int n = GetDecisionCount();
-
-    std::vector<bool> isLeaf(n, true);
+    if (m_piecesDirty) {
+        UpdatePieces();
+        m_piecesDirty = false;
+    }
 
-    for (Decision *decision : m_decisions) {
-        GetDepth(decision);
+    return m_pieces;
+}
 
-        if (decision->ParentDecision != nullptr) {
-            isLeaf[decision->ParentDecision->Index] = false;
+void toccata::DecisionTree::UpdatePieces() {
+    // Pieces with more matched notes, and then shorter pieces, take priority
+    // when two pieces overlap
+    auto lowerPriority = [](const PieceData &a, const PieceData &b) {
+        if (a.MatchedNotes == b.MatchedNotes) {
+            return a.GetLength() > b.GetLength();
         }
-    }
-
-    int leafCount = 0;
-    for (int i = 0; i < n; ++i) {
-        if (isLeaf[i]) ++leafCount;
-    }
+        else return a.MatchedNotes < b.MatchedNotes;
+    };
 
-    std::vector<PieceData> results;
-    for (int i = 0; i < n; ++i) {
-        if (!isLeaf[i]) continue;
+    std::priority_queue<PieceData, std::vector<PieceData>, decltype(lowerPriority)>
+        pending(lowerPriority);
 
-        Decision *parentDecision = m_decisions[i];
+    UpdateBranches();
 
-        int pieceStart = INT_MAX;
-        int pieceEnd = INT_MIN;
-        for (Decision *decision = parentDecision; decision != nullptr; decision = decision->ParentDecision) {
-            pieceStart = std::min(pieceStart, decision->GetStart());
-            pieceEnd = std::max(pieceEnd, decision->GetEnd());
-        }
+    for (Decision *decision : m_decisions) {
+        if (!decision->Children.IsEmpty()) continue;
 
         PieceData data;
-        data.Start = pieceStart;
-        data.End = pieceEnd;
-        data.ParentDecision = parentDecision;
-        data.StartDecision = parentDecision;
+        data.Start = decision->BranchStart;
+        data.End = decision->BranchEnd;
+        data.ParentDecision = decision;
+        data.StartDecision = decision;
         data.EndDecision = nullptr;
-        data.MatchedNotes = GetBranchNoteCount(parentDecision);
-        data.Filtered = false;
+        data.MatchedNotes = decision->BranchNoteCount;
 
-        results.push_back(data);
+        pending.push(data);
     }
 
-    std::sort(results.begin(), results.end(),
-        [](PieceData &a, PieceData &b) {
-            if (a.MatchedNotes == b.MatchedNotes) {
-                return (a.End - a.Start + 1) < (b.End - b.Start + 1);
-            }
-            else return a.MatchedNotes > b.MatchedNotes;
-        });
-
-    bool done = false;
-    while (!done) {
-        done = true;
-
-        for (int i = 0; i < (int)results.size(); ++i) {
-            for (int j = i + 1; j < (int)results.size(); ++j) {
-                PieceData &piece0 = results[i];
-                if (piece0.Filtered) continue;
-
-                const int length0 = piece0.End - piece0.Start + 1;
-
-                PieceData &piece1 = results[j];
-                if (piece1.Filtered) continue;
-
-                const int length1 = piece1.End - piece1.Start + 1;
-
-                const int start = std::max(piece0.Start, piece1.Start);
-                const int end = std::min(piece0.End, piece1.End);
-
-                const int overlap = std::max(0, end - start + 1);
-                const int overlapThreshold = (int)std::ceil(0.25 * std::min(length0, length1));
-
-                if (overlap >= overlapThreshold) {
-                    TrimPiece(j, results, piece0.Start, piece0.End);
-
-                    std::sort(results.begin(), results.end(),
-                        [](PieceData &a, PieceData &b) {
-                            if (a.MatchedNotes == b.MatchedNotes) {
-                                return (a.End - a.Start + 1) < (b.End - b.Start + 1);
-                            }
-                            else return a.MatchedNotes > b.MatchedNotes;
-                        });
-
-                    done = false;
+    // Every accepted piece has at least the priority of the pieces still
+    // pending, so each pending piece only needs to be checked against the
+    // accepted set. Fragments left over after trimming go back in the queue.
+    std::vector<PieceData> accepted;
+    std::vector<PieceData> fragments;
+    while (!pending.empty()) {
+        const PieceData piece = pending.top(); pending.pop();
+
+        bool trimmed = false;
+        for (const PieceData &other : accepted) {
+            const int start = std::max(piece.Start, other.Start);
+            const int end = std::min(piece.End, other.End);
+
+            const int overlap = std::max(0, end - start + 1);
+            const int overlapThreshold =
+                (int)std::ceil(0.25 * std::min(piece.GetLength(), other.GetLength()));
+
+            if (overlap >= overlapThreshold) {
+                fragments.clear();
+                TrimPiece(piece, other.Start, other.End, &fragments);
+
+                for (const PieceData &fragment : fragments) {
+                    pending.push(fragment);
                 }
+
+                trimmed = true;
+                break;
             }
         }
-    }
 
-    int newSize = 0;
-    for (int i = 0; i < (int)results.size(); ++i) {
-        if (results[i].Filtered) continue;
-
-        results[newSize++] = results[i];
+        if (!trimmed) {
+            accepted.push_back(piece);
+        }
     }
 
-    results.resize(newSize);
-
-    std::sort(results.begin(), results.end(),
-        [](PieceData &a, PieceData &b) {
+    std::sort(accepted.begin(), accepted.end(),
+        [](const PieceData &a, const PieceData &b) {
             return a.End < b.End;
         });
 
-    std::vector<MatchedPiece> pieces;
-    for (const PieceData &data : results) {
-        Decision *endDecision = data.EndDecision;
-        Decision *startDecision = data.StartDecision;
-        Decision *parentDecision = data.ParentDecision;
-        double s_avg = 0.0;
-        int s_samples = 0;
-        for (Decision *decision = parentDecision; decision != nullptr; decision = decision->ParentDecision) {
-            if (!decision->Singular) {
-                s_avg += decision->T.s;
-                ++s_samples;
-            }
-        }
-
-        s_avg /= s_samples;
-
-        MatchedPiece newPiece;
-        newPiece.Piece = startDecision->MatchedBar->GetPiece();
-        newPiece.Start = INT_MAX;
-        newPiece.End = INT_MIN;
-        newPiece.MatchedNotes = data.MatchedNotes;
-
-        for (Decision *decision = startDecision; decision != nullptr; decision = decision->ParentDecision) {
-            MatchedBar bar;
-            bar.MatchedBar = decision->MatchedBar;
-            bar.Start = decision->GetStart();
-            bar.End = decision->GetEnd();
-            bar.MatchedNotes = decision->MappedNotes;
-
-            if (decision->Singular && s_samples > 0) {
-                bar.T.s = s_avg;
-                bar.T.t = decision->T.t * s_avg;
-                bar.T.t_coarse = decision->T.t_coarse;
-            }
-            else if (!decision->Singular) {
-                bar.T = decision->T;
-            }
-            else {
-                const double s_default = decision->MatchedBar->GetSegment()->PulseRate / m_segment->PulseRate;
-                bar.T.t = decision->T.t * s_default;
-                bar.T.s = s_default;
-                bar.T.t_coarse = decision->T.t_coarse;
-            }
+    m_pieces.clear();
+    for (const PieceData &data : accepted) {
+        m_pieces.push_back(ConstructPiece(data));
+    }
+}
 
-            newPiece.Start = std::min(bar.Start, newPiece.Start);
-            newPiece.End = std::max(bar.End, newPiece.End);
+toccata::DecisionTree::MatchedPiece toccata::DecisionTree::ConstructPiece(const PieceData &data) const {
+    Decision *startDecision = data.StartDecision;
+    Decision *parentDecision = data.ParentDecision;
+    double s_avg = 0.0;
+    int s_samples = 0;
+    for (Decision *decision = parentDecision; decision != nullptr; decision = GetParent(decision)) {
+        if (!decision->Singular) {
+            s_avg += decision->T.s;
+            ++s_samples;
+        }
+    }
 
-            newPiece.Bars.push_back(bar);
+    s_avg /= s_samples;
+
+    MatchedPiece newPiece;
+    newPiece.Piece = startDecision->MatchedBar->GetPiece();
+    newPiece.Start = INT_MAX;
+    newPiece.End = INT_MIN;
+    newPiece.MatchedNotes = data.MatchedNotes;
+
+    for (Decision *decision = startDecision; decision != nullptr; decision = GetParent(decision)) {
+        MatchedBar bar;
+        bar.MatchedBar = decision->MatchedBar;
+        bar.Start = decision->GetStart();
+        bar.End = decision->GetEnd();
+        bar.MatchedNotes = decision->MappedNotes;
+
+        if (decision->Singular && s_samples > 0) {
+            bar.T.s = s_avg;
+            bar.T.t = decision->T.t * s_avg;
+            bar.T.t_coarse = decision->T.t_coarse;
+        }
+        else if (!decision->Singular) {
+            bar.T = decision->T;
+        }
+        else {
+            const double s_default = decision->MatchedBar->GetSegment()->PulseRate / m_segment->PulseRate;
+            bar.T.t = decision->T.t * s_default;
+            bar.T.s = s_default;
+            bar.T.t_coarse = decision->T.t_coarse;
         }
 
-        std::reverse(newPiece.Bars.begin(), newPiece.Bars.end());
+        newPiece.Start = std::min(bar.Start, newPiece.Start);
+        newPiece.End = std::max(bar.End, newPiece.End);
 
-        pieces.push_back(newPiece);
+        newPiece.Bars.push_back(bar);
     }
 
-    return pieces;
+    std::reverse(newPiece.Bars.begin(), newPiece.Bars.end());
+
+    return newPiece;
 }
 
-toccata::DecisionTree::Decision *toccata::DecisionTree::FindBestParent(const Decision *decision) const {
+toccata::DecisionTree::Decision *toccata::DecisionTree::FindBestParent(const Decision *decision) {
     int bestNoteCount = -1;
     Decision *best = nullptr;
 
-    const int decisions = GetDecisionCount();
-    for (int i = 0; i < decisions; ++i) {
-        Decision *prev = m_decisions[i];
+    m_parentCandidates.clear();
+    FindDecisions(
+        decision->GetStart() - ParentSearchFootprints * m_maxFootprint,
+        decision->GetEnd() - 1,
+        &m_parentCandidates);
 
+    for (Decision *prev : m_parentCandidates) {
         if (prev == decision) continue;
         else if (prev->GetEnd() < decision->GetEnd()) {
-            bool isOverlapping = false;
-            for (Decision *overlapping : prev->OverlappingDecisions) {
-                if (overlapping == decision) {
-                    isOverlapping = true;
-                    break;
-                }
-            }
-
-            if (isOverlapping) continue;
+            if (prev->OverlappingDecisions.Contains(decision->Handle)) continue;
 
             const Bar::SearchResult next = prev->MatchedBar->FindNext(decision->MatchedBar, 1);
             if (next.Offset == -1) {
@@ -519,8 +1268,9 @@ toccata::DecisionTree::Decision *toccata::DecisionTree::FindBestParent(const Dec
 
             if (trueDistance > distance + length * 0.5) continue;
 
-            GetDepth(prev);
-            const int noteCount = GetBranchNoteCount(prev);
+            assert(IsCached(prev));
+
+            const int noteCount = prev->BranchNoteCount;
             if (best == nullptr || noteCount > bestNoteCount || prev->GetEnd() > best->GetEnd()) {
                 best = prev;
                 bestNoteCount = noteCount;
@@ -531,37 +1281,134 @@ toccata::DecisionTree::Decision *toccata::DecisionTree::FindBestParent(const Dec
     return best;
 }
 
-bool toccata::DecisionTree::IntegrateDecision(Decision *decision) {
-    const int decisionCount = GetDecisionCount();
-    for (int i = 0; i < decisionCount; ++i) {
-        Decision *currentDecision = m_decisions[i];
+void toccata::DecisionTree::ResolveCandidates(ThreadContext &context) const {
+    context.SameDecisions.resize(context.CandidateCount);
+
+    for (int i = 0; i < context.CandidateCount; ++i) {
+        context.SameDecisions[i] = FindSameDecision(&context.Candidates[i], &context.Overlapping);
+    }
+}
 
-        const int minNoteCount = std::min(currentDecision->MappedNotes, decision->MappedNotes);
+toccata::DecisionTree::Decision *toccata::DecisionTree::FindSameDecision(
+    const Decision *candidate, std::vector<Decision *> *scratch) const
+{
+    scratch->clear();
+    FindOverlapping(candidate, scratch);
+
+    for (Decision *currentDecision : *scratch) {
+        const int minNoteCount = std::min(currentDecision->MappedNotes, candidate->MappedNotes);
         const int overlap = (int)std::ceil(0.5 * minNoteCount);
-        
-        if (decision->Overlapping(currentDecision, overlap)) {
-            if (decision->IsSameAs(currentDecision)) {
-                if (decision->IsBetterFitThan(currentDecision)) {
-                    UpdateDecision(currentDecision, decision);
-                }
 
-                return false;
+        if (candidate->Overlapping(currentDecision, overlap)) {
+            if (candidate->IsSameAs(currentDecision)) {
+                return currentDecision;
             }
         }
     }
 
+    return nullptr;
+}
+
+toccata::DecisionTree::Decision *toccata::DecisionTree::InsertDecision(const Decision *candidate) {
+    // Only accepted candidates are copied out of the thread's buffer
+    Decision *decision = AllocateDecision();
+    CopyMatch(decision, candidate);
+
+    m_piecesDirty = true;
+
     decision->Index = GetDecisionCount();
+    decision->Sequence = m_nextSequence++;
     m_decisions.push_back(decision);
 
+    AddToIndex(decision);
+
     InvalidateAfter(decision->GetEnd());
     UpdateOverlapMatrix(decision);
 
-    return true;
+    return decision;
+}
+
+toccata::DecisionTree::Decision *toccata::DecisionTree::AllocateDecision() {
+    const ObjectHandle handle = m_decisionPool.Allocate();
+
+    Decision *decision = m_decisionPool.Resolve(handle);
+    decision->Handle = handle;
+    decision->Cached = false;
+    decision->Depth = 0;
+    decision->ParentDecision = ObjectHandle();
+    decision->Children.Clear();
+    decision->OverlappingDecisions.Clear();
+
+    return decision;
+}
+
+void toccata::DecisionTree::DestroyDecision(Decision *decision) {
+    m_decisionPool.Free(decision->Handle);
+}
+
+void toccata::DecisionTree::CopyMatch(Decision *target, const Decision *source) {
+    target->AverageError = source->AverageError;
+    target->MappedNotes = source->MappedNotes;
+    target->Notes = source->Notes;
+    target->WindowStart = source->WindowStart;
+    target->WindowEnd = source->WindowEnd;
+    target->T = source->T;
+    target->ReverifiedStreak = source->ReverifiedStreak;
+    target->MatchedBar = source->MatchedBar;
+    target->Singular = source->Singular;
+}
+
+void toccata::DecisionTree::AddToIndex(Decision *decision) {
+    m_endIndex.insert({ decision->GetEnd(), decision });
+    m_maxFootprint = std::max(m_maxFootprint, decision->GetFootprint());
+}
+
+void toccata::DecisionTree::RemoveFromIndex(Decision *decision) {
+    m_endIndex.erase({ decision->GetEnd(), decision });
+}
+
+void toccata::DecisionTree::FindDecisions(int endMin, int endMax, std::vector<Decision *> *target) const {
+    const size_t previousSize = target->size();
+
+    auto begin = m_endIndex.lower_bound({ endMin, nullptr });
+    for (auto i = begin; i != m_endIndex.end() && i->first <= endMax; ++i) {
+        target->push_back(i->second);
+    }
+
+    ++m_decisionQueries;
+    m_visitedDecisions += (long long)(target->size() - previousSize);
+
+    // Keep the order in which decisions were integrated so that ties are
+    // resolved the same way regardless of how the index is laid out
+    std::sort(target->begin(), target->end(),
+        [](const Decision *a, const Decision *b) {
+            return a->Sequence < b->Sequence;
+        });
+}
+
+void toccata::DecisionTree::FindOverlapping(const Decision *decision, std::vector<Decision *> *target) const {
+    // A decision can only share notes with decisions whose range intersects
+    // its own, and no decision spans more than m_maxFootprint notes
+    const int start = decision->GetStart();
+    const int end = decision->GetEnd();
+
+    FindDecisions(start, end + m_maxFootprint - 1, target);
+
+    int j = 0;
+    for (Decision *candidate : *target) {
+        if (candidate->GetStart() <= end) {
+            (*target)[j++] = candidate;
+        }
+    }
+
+    target->resize(j);
 }
 
 void toccata::DecisionTree::WorkerThread(int threadId) {
     ThreadContext &context = m_threadContexts[threadId];
 
+    if (!ThreadUtilities::Apply(m_realtimeSettings)) ++m_realtimeFailures;
+
     while (!context.Kill) {
         std::unique_lock<std::mutex> lk(context.Lock);
         context.ConditionVariable
@@ -581,71 +1428,399 @@ void toccata::DecisionTree::WorkerThread(int threadId) {
 }
 
 void toccata::DecisionTree::Work(int threadId, ThreadContext &context) {
-    SeedMatch(context.LibraryStart, context.LibraryEnd, threadId);
+    SeedMatch(threadId);
+    ResolveCandidates(context);
 }
 
-void toccata::DecisionTree::SeedMatch(
-    int libraryStart, int libraryEnd, int threadId) 
-{
+void toccata::DecisionTree::SeedMatch(int threadId) {
     ThreadContext &context = m_threadContexts[threadId];
 
-    for (int i = libraryStart; i <= libraryEnd; ++i) {
-        Bar *bar = m_library->GetBar(i);
-        Decision *newDecision = Match(bar, context.StartIndex, context);
+    context.CandidateCount = 0;
 
-        if (newDecision != nullptr) {
-            newDecision->ParentDecision = nullptr;
-            context.NewDecisions.push(newDecision);
+    const bool timed = context.Deadline != std::chrono::steady_clock::time_point::max();
+    const int slotCount = (int)m_passStartIndices.size();
+
+    bool first = true;
+    for (; context.TaskCursor < m_passTaskCount; context.TaskCursor += m_activeThreadCount) {
+        const int slot = context.TaskCursor % slotCount;
+        const int startIndex = m_passStartIndices[slot];
+        if (startIndex < 0) continue;
+
+        if (context.Token != nullptr && context.Token->IsCancelled()) {
+            context.CandidateCount = 0;
+            return;
+        }
+
+        // At least one bar is matched per slice so that a pass can't stall
+        if (timed && !first && std::chrono::steady_clock::now() >= context.Deadline) {
+            return;
+        }
+
+        first = false;
+
+        if (context.CandidateCount >= (int)context.Candidates.size()) {
+            context.Candidates.resize((size_t)context.CandidateCount + 1);
+        }
+
+        // Orders are shorter for start indices that follow a locked piece
+        const std::vector<int> &order = m_barOrders[slot];
+        const int rank = context.TaskCursor / slotCount;
+        if (rank >= (int)order.size()) continue;
+
+        const int barIndex = order[rank];
+        if (!MayMatch(m_library->GetBar(barIndex), slot)) {
+            ++context.Prefiltered;
+            continue;
+        }
+
+        if (CachedMatch(barIndex, startIndex, context, &context.Candidates[context.CandidateCount])) {
+            ++context.CandidateCount;
+
+            if (m_deduplicationEnabled) ShareMatch(m_library->GetBar(barIndex), context);
         }
     }
 }
 
-toccata::DecisionTree::Decision *toccata::DecisionTree::Match(
-    const Bar *reference,
+void toccata::DecisionTree::TrimMatchCache() {
+    // Workers aren't running, so tables can be freed here
+    if (m_residency != nullptr) {
+        m_evictedBars.clear();
+        m_residency->DrainEvicted(&m_evictedBars);
+
+        for (int bar : m_evictedBars) {
+            m_matchCache.Release(bar);
+        }
+    }
+
+    m_matchCache.Trim();
+    m_matchCache.BeginPass();
+}
+
+bool toccata::DecisionTree::CachedMatch(
+    int barIndex,
     int startIndex,
-    ThreadContext &context) 
+    ThreadContext &context,
+    Decision *target)
+{
+    const Bar *reference = m_library->GetBar(barIndex);
+
+    if (!m_matchCacheEnabled) {
+        return Match(reference, startIndex, context, target);
+    }
+
+    if (m_segment->NoteContainer.GetCount() == 0) return false;
+
+    const int windowEnd = GetWindowEnd(reference, startIndex);
+    unsigned long long fingerprint =
+        MatchCache::Fingerprint(m_segment, startIndex, windowEnd);
+
+    // Only bars with a tatum of their own are constrained by the prior
+    const bool prior = m_inputTatum > 0.0 && m_barTatums[reference->GetId()] > 0.0;
+    fingerprint = MatchCache::Combine(fingerprint, prior ? 1 : 0);
+    if (prior) {
+        const long long tatumBucket =
+            std::llround(std::log(m_inputTatum) / std::log1p(CacheTatumResolution));
+        fingerprint = MatchCache::Combine(fingerprint, (unsigned long long)tatumBucket);
+    }
+
+    const int position = startIndex + m_retiredNotes;
+    MatchCache::Entry &cached = context.CacheEntry;
+    if (m_matchCache.Find(barIndex, position, fingerprint, &cached)) {
+        ++context.CacheHits;
+        if (!cached.Found) return false;
+
+        target->Notes.resize(cached.Notes.size());
+        for (size_t i = 0; i < cached.Notes.size(); ++i) {
+            target->Notes[i] = cached.Notes[i] + startIndex;
+        }
+
+        target->AverageError = cached.AverageError;
+        target->T = cached.T;
+        target->ReverifiedStreak = cached.ReverifiedStreak;
+        target->MappedNotes = cached.MappedNotes;
+        target->MatchedBar = reference;
+        target->Singular = cached.Singular;
+        target->WindowStart = startIndex;
+        target->WindowEnd = startIndex + GetWindowLength(reference) - 1;
+
+        return true;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool found = Match(reference, startIndex, context, target);
+    const std::chrono::duration<double> solveTime = std::chrono::steady_clock::now() - start;
+
+    ++context.CacheMisses;
+    context.SolveTime += solveTime.count();
+
+    cached.Found = found;
+    cached.Notes.clear();
+
+    if (found) {
+        cached.Notes.resize(target->Notes.size());
+        for (size_t i = 0; i < target->Notes.size(); ++i) {
+            cached.Notes[i] = target->Notes[i] - startIndex;
+        }
+
+        cached.AverageError = target->AverageError;
+        cached.T = target->T;
+        cached.ReverifiedStreak = target->ReverifiedStreak;
+        cached.MappedNotes = target->MappedNotes;
+        cached.Singular = target->Singular;
+    }
+
+    m_matchCache.Store(barIndex, position, fingerprint, cached);
+
+    return found;
+}
+
+bool toccata::DecisionTree::Reverify(
+    const Bar *reference,
+    const FullSolver::Request &request,
+    ThreadContext &context,
+    FullSolver::Result *result,
+    int *streak)
+{
+    // Decisions are only read here, they can't change until the workers
+    // are done
+    context.Nearby.clear();
+    FindDecisions(request.StartIndex, request.EndIndex, &context.Nearby);
+
+    FullSolver::Result candidate;
+    candidate.Fit.Target = &context.ReverifiedNotes;
+
+    bool found = false;
+    bool refreshDue = false;
+    for (const Decision *decision : context.Nearby) {
+        if (decision->MatchedBar->GetCanonical() != reference->GetCanonical()) continue;
+
+        // Transforms that have been carried over for too long are solved
+        // for again so that errors don't accumulate
+        if (decision->ReverifiedStreak >= ReverificationRefreshInterval) {
+            refreshDue = true;
+            continue;
+        }
+
+        ++context.ReverificationAttempts;
+
+        candidate.Fit.Target->clear();
+        if (!context.Solver.Verify(request, decision->T, &candidate)) continue;
+
+        // Same order as the solver, more mapped notes first and then the
+        // lower error
+        if (found) {
+            if (candidate.Fit.MappedNotes < result->Fit.MappedNotes) continue;
+            else if (candidate.Fit.MappedNotes == result->Fit.MappedNotes &&
+                candidate.Fit.AverageError >= result->Fit.AverageError) continue;
+        }
+
+        std::vector<int> *notes = result->Fit.Target;
+        notes->swap(*candidate.Fit.Target);
+
+        *result = candidate;
+        result->Fit.Target = notes;
+
+        *streak = decision->ReverifiedStreak + 1;
+        found = true;
+    }
+
+    if (found) ++context.Reverified;
+    else if (refreshDue) ++context.ReverificationRefreshes;
+
+    return found;
+}
+
+bool toccata::DecisionTree::Predict(
+    const Bar *reference,
+    ThreadContext &context,
+    FullSolver::Request *request,
+    Transform *T) const
 {
+    const int startIndex = request->StartIndex;
+
+    // Branches are up to date while the workers run, see MatchSlice
+    context.Predecessors.clear();
+    FindDecisions(startIndex - PredecessorSearchNotes, startIndex - 1, &context.Predecessors);
+
+    const Decision *best = nullptr;
+    for (const Decision *decision : context.Predecessors) {
+        if (!IsCached(decision) || !decision->Tempo.IsValid()) continue;
+        else if (!IsReachable(decision->MatchedBar, reference)) continue;
+
+        if (best == nullptr || decision->BranchNoteCount > best->BranchNoteCount) {
+            best = decision;
+        }
+    }
+
+    if (best == nullptr) return false;
+
+    TempoTracker tempo = best->Tempo;
+    tempo.Predict(best->MatchedBar->GetSegment()->GetNormalizedLength());
+
+    const double period = tempo.GetPeriod();
+    if (period <= 0.0) return false;
+
+    const MusicSegment *segment = reference->GetSegment();
+    const MusicPoint *points = m_segment->NoteContainer.GetPoints();
+    const double tolerance = PredictionSigmas * std::sqrt(tempo.GetBoundaryVariance());
+
+    // The window has to start with the bar's first note
+    const double firstNote = tempo.GetBoundary()
+        + period * segment->Normalize(segment->NoteContainer.GetPoints()[0].Timestamp);
+    if (std::abs(m_segment->Normalize(points[startIndex].Timestamp) - firstNote) > tolerance) {
+        return false;
+    }
+
+    const double barEnd = tempo.GetBoundary() + period * segment->GetNormalizedLength() + tolerance;
+    int end = startIndex;
+    while (end < request->EndIndex && m_segment->Normalize(points[end + 1].Timestamp) <= barEnd) {
+        ++end;
+    }
+
+    const double s = 1.0 / period;
+    const double scaleTolerance = std::max(
+        MinimumScaleTolerance,
+        PredictionSigmas * std::sqrt(tempo.GetPeriodVariance()) / period);
+
+    request->EndIndex = end;
+    request->MinScale = s * (1 - scaleTolerance);
+    request->MaxScale = s * (1 + scaleTolerance);
+
+    T->t_coarse = points[startIndex].Timestamp;
+    T->s = s;
+    T->t = -s * (tempo.GetBoundary() - m_segment->Normalize(T->t_coarse));
+
+    return true;
+}
+
+int toccata::DecisionTree::GetWindowEnd(const Bar *reference, int startIndex) const {
+    const int k = m_segment->NoteContainer.GetCount();
+
+    const int end = startIndex + GetWindowLength(reference) - 1;
+    return (end >= k)
+        ? k - 1
+        : end;
+}
+
+int toccata::DecisionTree::GetWindowLength(const Bar *reference) const {
     const int n = reference->GetSegment()->NoteContainer.GetCount();
+    return (int)std::ceil(n * (1.0 + m_margin));
+}
+
+int toccata::DecisionTree::GetMaxWindowLength() const {
+    if (m_library == nullptr) return 1;
+
+    // Bars are only ever added to the library, so only new ones are checked
+    const int barCount = m_library->GetBarCount();
+    if (barCount < m_maxWindowBarCount) m_maxWindowBarCount = 0;
+    if (m_maxWindowBarCount == 0) m_maxWindowLength = 1;
+
+    for (int i = m_maxWindowBarCount; i < barCount; ++i) {
+        m_maxWindowLength = std::max(m_maxWindowLength, GetWindowLength(m_library->GetBar(i)));
+    }
+
+    m_maxWindowBarCount = barCount;
+
+    return m_maxWindowLength;
+}
+
+bool toccata::DecisionTree::Match(
+    const Bar *reference,
+    int startIndex,
+    ThreadContext &context,
+    Decision *target) 
+{
     const int k = m_segment->NoteContainer.GetCount();
 
-    if (k == 0) return nullptr;
+    if (k == 0) return false;
 
-    std::set<int> mappedNotes;
+    if (m_residency != nullptr) m_residency->Touch(reference);
+
+    // Pitches index per-pitch tables in the solver
+    if (!reference->GetSegment()->NoteContainer.CheckPitches(Library::MaxPitches)) return false;
+
+    target->Notes.clear();
 
     FullSolver::Result result;
-    result.Fit.Target = &mappedNotes;
+    result.Fit.Target = &target->Notes;
 
     FullSolver::Request request;
-    request.MissingNoteThreshold = 0.25;
+    request.MissingNoteThreshold = MissingNoteThreshold;
     request.StartIndex = startIndex;
-    request.EndIndex = startIndex + (int)std::ceil(n * (1.0 + m_margin)) - 1;
-    if (request.EndIndex >= k) request.EndIndex = k - 1;
+    request.EndIndex = GetWindowEnd(reference, startIndex);
     request.Reference = reference->GetSegment();
     request.Segment = m_segment;
 
-    const bool foundSolution = context.Solver.Solve(request, &result);
-    if (!foundSolution) return nullptr;
+    if (m_inputTatum > 0.0) {
+        request.ReferenceTatum = m_barTatums[reference->GetId()];
+        request.InputTatum = m_inputTatum;
+    }
+
+    // A bar that matched a nearby window usually matches this one with
+    // the same transform, which is much cheaper to check than to find
+    bool foundSolution = false;
+    int reverifiedStreak = 0;
+    if (m_reverificationEnabled) {
+        foundSolution = Reverify(reference, request, context, &result, &reverifiedStreak);
+    }
 
-    Decision *newDecision = AllocateDecision();
-    newDecision->AverageError = result.Fit.AverageError;
-    newDecision->T = result.T;
-    newDecision->Notes = mappedNotes;
-    newDecision->MappedNotes = result.Fit.MappedNotes;
-    newDecision->MatchedBar = reference;
-    newDecision->Singular = result.Singular;
+    if (!foundSolution) {
+        // The predicted transform is checked first, then the predicted
+        // window is searched within the predicted scale range
+        bool solved = false;
+        FullSolver::Request narrowed = request;
+        Transform predicted;
+        if (m_tempoTrackingEnabled && Predict(reference, context, &narrowed, &predicted)) {
+            ++context.PredictionAttempts;
 
-    return newDecision;
-}
+            target->Notes.clear();
+            foundSolution = context.Solver.Verify(narrowed, predicted, &result);
+
+            if (!foundSolution) {
+                solved = true;
+
+                target->Notes.clear();
+                foundSolution = context.Solver.Solve(narrowed, &result);
+            }
+
+            if (foundSolution) ++context.Predicted;
+        }
+
+        if (!foundSolution) {
+            solved = true;
+
+            target->Notes.clear();
+            foundSolution = context.Solver.Solve(request, &result);
+        }
+
+        if (solved) ++context.FullSolves;
+    }
 
-void toccata::DecisionTree::TrimPiece(int index, std::vector<PieceData> &pieceData, int startTrim, int endTrim) {
-    pieceData[index].Filtered = true;
+    if (!foundSolution) return false;
 
+    std::sort(target->Notes.begin(), target->Notes.end());
+
+    target->AverageError = result.Fit.AverageError;
+    target->T = result.T;
+    target->ReverifiedStreak = reverifiedStreak;
+    target->MappedNotes = result.Fit.MappedNotes;
+    target->MatchedBar = reference;
+    target->Singular = result.Singular;
+    target->WindowStart = startIndex;
+    target->WindowEnd = startIndex + GetWindowLength(reference) - 1;
+
+    return true;
+}
+
+void toccata::DecisionTree::TrimPiece(
+    const PieceData &piece, int startTrim, int endTrim, std::vector<PieceData> *fragments) const 
+{
     Decision *newStart = nullptr;
     Decision *newEnd = nullptr;
     for (
-        Decision *currentDecision = pieceData[index].StartDecision;
-        currentDecision != pieceData[index].EndDecision;
-        currentDecision = currentDecision->ParentDecision) 
+        Decision *currentDecision = piece.StartDecision;
+        currentDecision != piece.EndDecision;
+        currentDecision = GetParent(currentDecision)) 
     {
         const int start = std::max(currentDecision->GetStart(), startTrim);
         const int end = std::min(currentDecision->GetEnd(), endTrim);
@@ -655,31 +1830,14 @@ void toccata::DecisionTree::TrimPiece(int index, std::vector<PieceData> &pieceDa
                 newStart = newEnd = currentDecision;
             }
             else {
-                newEnd = currentDecision->ParentDecision;
+                newEnd = GetParent(currentDecision);
             }
         }
         else {
             newEnd = currentDecision;
 
             if (newStart != nullptr && newStart != newEnd) {
-                PieceData newPiece;
-                newPiece.Start = INT_MAX;
-                newPiece.End = INT_MIN;
-                newPiece.ParentDecision = pieceData[index].ParentDecision;
-                newPiece.StartDecision = newStart;
-                newPiece.EndDecision = newEnd;
-                newPiece.MatchedNotes = 0;
-                newPiece.Filtered = false;
-                for (
-                    Decision *currentDecision = newPiece.StartDecision;
-                    currentDecision != newPiece.EndDecision;
-                    currentDecision = currentDecision->ParentDecision) {
-                    newPiece.Start = std::min(newPiece.Start, currentDecision->GetStart());
-                    newPiece.End = std::max(newPiece.End, currentDecision->GetEnd());
-                    newPiece.MatchedNotes += currentDecision->MappedNotes;
-                }
-
-                pieceData.push_back(newPiece);
+                AddFragment(piece.ParentDecision, newStart, newEnd, fragments);
             }
 
             newStart = nullptr;
@@ -688,24 +1846,60 @@ void toccata::DecisionTree::TrimPiece(int index, std::vector<PieceData> &pieceDa
     }
 
     if (newStart != nullptr && newStart != newEnd) {
-        PieceData newPiece;
-        newPiece.Start = INT_MAX;
-        newPiece.End = INT_MIN;
-        newPiece.ParentDecision = pieceData[index].ParentDecision;
-        newPiece.StartDecision = newStart;
-        newPiece.EndDecision = newEnd;
-        newPiece.MatchedNotes = 0;
-        newPiece.Filtered = false;
-        for (
-            Decision *currentDecision = newPiece.StartDecision;
-            currentDecision != newPiece.EndDecision;
-            currentDecision = currentDecision->ParentDecision) {
-            newPiece.Start = std::min(newPiece.Start, currentDecision->GetStart());
-            newPiece.End = std::max(newPiece.End, currentDecision->GetEnd());
-            newPiece.MatchedNotes += currentDecision->MappedNotes;
+        AddFragment(piece.ParentDecision, newStart, newEnd, fragments);
+    }
+}
+
+void toccata::DecisionTree::AddFragment(
+    Decision *parent, Decision *start, Decision *end, std::vector<PieceData> *fragments) const 
+{
+    PieceData newPiece;
+    newPiece.Start = INT_MAX;
+    newPiece.End = INT_MIN;
+    newPiece.ParentDecision = parent;
+    newPiece.StartDecision = start;
+    newPiece.EndDecision = end;
+    newPiece.MatchedNotes = 0;
+    for (
+        Decision *currentDecision = newPiece.StartDecision;
+        currentDecision != newPiece.EndDecision;
+        currentDecision = GetParent(currentDecision)) 
+    {
+        newPiece.Start = std::min(newPiece.Start, currentDecision->GetStart());
+        newPiece.End = std::max(newPiece.End, currentDecision->GetEnd());
+        newPiece.MatchedNotes += currentDecision->MappedNotes;
+    }
+
+    fragments->push_back(newPiece);
+}
+
+void toccata::DecisionTree::InvalidateCache(Decision *decision) {
+    m_firstInvalidEnd = std::min(m_firstInvalidEnd, decision->GetEnd());
+
+    // A decision that isn't cached has no parent and no children
+    if (!IsCached(decision)) return;
+
+    Decision *parent = GetParent(decision);
+    if (parent != nullptr) {
+        parent->Children.Remove(parent->Children.Find(decision->Handle));
+    }
+
+    // Descendants were built on top of this branch so they are invalidated
+    // too. All of them end after this decision.
+    m_invalidationStack.clear();
+    m_invalidationStack.push_back(decision);
+    while (!m_invalidationStack.empty()) {
+        Decision *current = m_invalidationStack.back();
+        m_invalidationStack.pop_back();
+
+        for (const ObjectHandle &child : current->Children) {
+            m_invalidationStack.push_back(m_decisionPool.Resolve(child));
         }
 
-        pieceData.push_back(newPiece);
+        current->Children.Clear();
+        current->Cached = false;
+        current->ParentDecision = ObjectHandle();
+        current->Depth = 0;
     }
 }
 
@@ -728,31 +1922,16 @@ bool toccata::DecisionTree::Decision::IsBetterFitThan(const Decision *decision)
     else return false;
 }
 
-bool toccata::DecisionTree::Decision::IsCached() const {
-    if (!Cached) return false;
-    
-    if (ParentDecision != nullptr) {
-        return ParentDecision->IsCached();
-    }
-    else return true;
-}
-
-void toccata::DecisionTree::Decision::InvalidateCache() {
-    Cached = false;
-    ParentDecision = nullptr;
-    Depth = 0;
-}
-
 int toccata::DecisionTree::Decision::GetFootprint() const {
     return GetEnd() - GetStart() + 1;
 }
 
 int toccata::DecisionTree::Decision::GetEnd() const {
-    return *(Notes.rbegin());
+    return Notes.back();
 }
 
 int toccata::DecisionTree::Decision::GetStart() const {
-    return *Notes.begin();
+    return Notes.front();
 }
 
 bool toccata::DecisionTree::Decision::Overlapping(const Decision *decision, int overlap) const {
@@ -761,10 +1940,18 @@ bool toccata::DecisionTree::Decision::Overlapping(const Decision *decision, int
     
     if (decision->MappedNotes < MappedNotes) return decision->Overlapping(this, overlap);
     
+    // Both note lists are sorted so shared notes can be counted in one pass
+    const std::vector<int> &notes0 = Notes;
+    const std::vector<int> &notes1 = decision->Notes;
+
     int sharedNotes = 0;
-    for (int n0 : Notes) {
-        if (decision->Notes.count(n0) > 0) {
+    size_t i = 0, j = 0;
+    while (i < notes0.size() && j < notes1.size()) {
+        if (notes0[i] < notes1[j]) ++i;
+        else if (notes0[i] > notes1[j]) ++j;
+        else {
             if (++sharedNotes >= overlap) return true;
+            ++i; ++j;
         }
     }
 
@@ -0,0 +1,98 @@
+#include "../include/dirty_range_queue.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <iterator>
+#include <vector>
+
+toccata::DirtyRangeQueue::DirtyRangeQueue() {
+    m_size = 0;
+}
+
+toccata::DirtyRangeQueue::~DirtyRangeQueue() {
+    /* void */
+}
+
+void toccata::DirtyRangeQueue::Add(int start, int end) {
+    if (start > end) return;
+
+    // Absorb every range that overlaps or touches the new one
+    auto i = m_ranges.upper_bound(start);
+    if (i != m_ranges.begin() && std::prev(i)->second >= start - 1) --i;
+
+    while (i != m_ranges.end() && i->first <= end + 1) {
+        start = std::min(start, i->first);
+        end = std::max(end, i->second);
+
+        m_size -= i->second - i->first + 1;
+        i = m_ranges.erase(i);
+    }
+
+    m_ranges[start] = end;
+    m_size += end - start + 1;
+}
+
+void toccata::DirtyRangeQueue::Insert(int index) {
+    auto i = m_ranges.lower_bound(index);
+
+    std::vector<std::pair<int, int>> shifted(i, m_ranges.end());
+    m_ranges.erase(i, m_ranges.end());
+
+    // A range that straddles the index is split around the new element
+    if (!m_ranges.empty()) {
+        auto last = std::prev(m_ranges.end());
+        if (last->second >= index) {
+            shifted.insert(shifted.begin(), { index, last->second });
+            last->second = index - 1;
+        }
+    }
+
+    for (const std::pair<int, int> &range : shifted) {
+        m_ranges[range.first + 1] = range.second + 1;
+    }
+}
+
+void toccata::DirtyRangeQueue::Remove(int count) {
+    if (count <= 0) return;
+
+    std::map<int, int> ranges;
+    m_size = 0;
+
+    for (const auto &range : m_ranges) {
+        if (range.second < count) continue;
+
+        const int start = std::max(range.first, count) - count;
+        const int end = range.second - count;
+
+        ranges[start] = end;
+        m_size += end - start + 1;
+    }
+
+    m_ranges.swap(ranges);
+}
+
+int toccata::DirtyRangeQueue::Pop() {
+    assert(!IsEmpty());
+
+    auto first = m_ranges.begin();
+    const int index = first->first;
+    const int end = first->second;
+
+    m_ranges.erase(first);
+    if (index < end) m_ranges[index + 1] = end;
+
+    --m_size;
+
+    return index;
+}
+
+int toccata::DirtyRangeQueue::GetFirst() const {
+    assert(!IsEmpty());
+
+    return m_ranges.begin()->first;
+}
+
+void toccata::DirtyRangeQueue::Clear() {
+    m_ranges.clear();
+    m_size = 0;
+}
@@ -3,12 +3,14 @@
 #include "../include/segment_utilities.h"
 #include "../include/nls_optimizer.h"
 #include "../include/memory.h"
+#include "../include/thread_utilities.h"
 
 toccata::FullSolver::FullSolver() {
 	memset(&m_memorySpace, 0, sizeof(Memory));
 
     m_testPatternBuffer = nullptr;
     m_notesByPitchBuffer = nullptr;
+    m_mappedBuffer = nullptr;
 }
 
 toccata::FullSolver::~FullSolver() { 
@@ -18,6 +20,7 @@ toccata::FullSolver::~FullSolver() {
 void toccata::FullSolver::Initialize() {
     m_testPatternBuffer = Memory::Allocate<int>(NoteBufferSize);
     m_notesByPitchBuffer = Memory::Allocate2d<int>(MaxPitches, NoteBufferSize);
+    m_mappedBuffer = Memory::Allocate<bool>(NoteBufferSize);
 
     TestPatternEvaluator::AllocateMemorySpace(&m_memorySpace, NoteBufferSize, NoteBufferSize, NoteBufferSize);
 
@@ -29,6 +32,19 @@ void toccata::FullSolver::Release() {
 
     Memory::Free(m_testPatternBuffer);
     Memory::Free2d(m_notesByPitchBuffer);
+    Memory::Free(m_mappedBuffer);
+}
+
+bool toccata::FullSolver::LockMemory() {
+    bool locked = true;
+    locked = ThreadUtilities::Lock(m_testPatternBuffer, NoteBufferSize) && locked;
+    locked = ThreadUtilities::Lock2d(m_notesByPitchBuffer, NoteBufferSize) && locked;
+    locked = ThreadUtilities::Lock(m_mappedBuffer, NoteBufferSize) && locked;
+
+    locked = TestPatternEvaluator::LockMemorySpace(
+        &m_memorySpace, NoteBufferSize, NoteBufferSize, NoteBufferSize) && locked;
+
+    return locked;
 }
 
 bool toccata::FullSolver::Solve(const Request &request, Result *result) {
@@ -56,9 +72,15 @@ bool toccata::FullSolver::Solve(const Request &request, Result *result) {
 	te_request.TestPattern = m_testPatternBuffer;
 	te_request.TestPatternLength = patternLength;
 	te_request.SegmentNotesByPitch = m_notesByPitchBuffer;
+	te_request.MinScale = request.MinScale;
+	te_request.MaxScale = request.MaxScale;
+	te_request.ReferenceTatum = request.ReferenceTatum;
+	te_request.InputTatum = request.InputTatum;
 	te_request.Memory = m_memorySpace;
 
 	const bool found = toccata::TestPatternEvaluator::Solve(te_request, &output);
+	m_evaluatedHypotheses += output.EvaluatedHypotheses;
+
 	if (!found) return false;
 
 	toccata::NoteMapper::InjectiveMappingRequest mappingRequest;
@@ -73,20 +95,72 @@ bool toccata::FullSolver::Solve(const Request &request, Result *result) {
 
 	const int *preciseMapping = toccata::NoteMapper::GetInjectiveMapping(&mappingRequest);
 
+	return Refine(request, preciseMapping, output.T, result);
+}
+
+bool toccata::FullSolver::Verify(const Request &request, const Transform &T, Result *result) {
+	const MusicSegment *reference = request.Reference;
+	const MusicSegment *segment = request.Segment;
+
+	SegmentUtilities::SortByPitch(
+		segment, request.StartIndex, request.EndIndex, MaxPitches, m_notesByPitchBuffer);
+
+	toccata::NoteMapper::NNeighborMappingRequest mappingRequest;
+	mappingRequest.ReferenceSegment = reference;
+	mappingRequest.Segment = segment;
+	mappingRequest.Start = request.StartIndex;
+	mappingRequest.End = request.EndIndex;
+	mappingRequest.T = T;
+	mappingRequest.CorrelationThreshold = request.CorrelationThreshold;
+	mappingRequest.NotesByPitch = m_notesByPitchBuffer;
+	mappingRequest.Target = m_memorySpace.Mapping;
+
+	const int *mapping = toccata::NoteMapper::GetMapping(&mappingRequest);
+
+	// Two reference notes claiming the same note means the transform no
+	// longer fits well enough to skip the full solve
+	const int n = reference->NoteContainer.GetCount();
+	const int m = request.EndIndex - request.StartIndex + 1;
+	for (int i = 0; i < m; ++i) {
+		m_mappedBuffer[i] = false;
+	}
+
+	int mappedNotes = 0;
+	for (int i = 0; i < n; ++i) {
+		if (mapping[i] == -1) continue;
+
+		bool &mapped = m_mappedBuffer[mapping[i] - request.StartIndex];
+		if (mapped) return false;
+
+		mapped = true;
+		++mappedNotes;
+	}
+
+	if ((n - mappedNotes) / (double)n > request.MissingNoteThreshold) return false;
+
+	return Refine(request, mapping, T, result);
+}
+
+bool toccata::FullSolver::Refine(const Request &request, const int *mapping, const Transform &coarse, Result *result) {
+	const MusicSegment *reference = request.Reference;
+	const MusicSegment *segment = request.Segment;
+
+	const int n = reference->NoteContainer.GetCount();
+
 	int validPointCount = 0;
 	double *r = m_memorySpace.r;
 	double *p = m_memorySpace.p;
 	const MusicPoint *referencePoints = reference->NoteContainer.GetPoints();
 	const MusicPoint *points = segment->NoteContainer.GetPoints();
 	for (int i = 0; i < n; ++i) {
-		if (preciseMapping[i] != -1) {
-			const int noteIndex = preciseMapping[i];
+		if (mapping[i] != -1) {
+			const int noteIndex = mapping[i];
 
 			const MusicPoint &referencePoint = referencePoints[i];
 			const MusicPoint &point = points[noteIndex];
 
 			r[validPointCount] = reference->Normalize(referencePoint.Timestamp);
-			p[validPointCount] = segment->Normalize(output.T.Local(point.Timestamp));
+			p[validPointCount] = segment->Normalize(coarse.Local(point.Timestamp));
 
 			++validPointCount;
 		}
@@ -101,12 +175,12 @@ bool toccata::FullSolver::Solve(const Request &request, Result *result) {
 	if (!solvable) return false;
 
 	Comparator::Request comparatorRequest;
-	comparatorRequest.Mapping = preciseMapping;
+	comparatorRequest.Mapping = mapping;
 	comparatorRequest.Reference = reference;
 	comparatorRequest.Segment = segment;
 	comparatorRequest.T.s = refinedSolution.s;
 	comparatorRequest.T.t = refinedSolution.t;
-	comparatorRequest.T.t_coarse = output.T.t_coarse;
+	comparatorRequest.T.t_coarse = coarse.t_coarse;
 	Comparator::CalculateError(comparatorRequest, &result->Fit);
 
 	int missedNotes = n - result->Fit.MappedNotes;
@@ -117,7 +191,7 @@ bool toccata::FullSolver::Solve(const Request &request, Result *result) {
 	{
 		result->T.s = refinedSolution.s;
 		result->T.t = refinedSolution.t;
-		result->T.t_coarse = output.T.t_coarse;
+		result->T.t_coarse = coarse.t_coarse;
 		result->Singular = refinedSolution.Singularity;
 		return true;
 	}
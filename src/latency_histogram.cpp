@@ -0,0 +1,62 @@
+#include "../include/latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+toccata::LatencyHistogram::LatencyHistogram() {
+    Clear();
+}
+
+toccata::LatencyHistogram::~LatencyHistogram() {
+    /* void */
+}
+
+void toccata::LatencyHistogram::Record(double latency) {
+    ++m_buckets[GetBucketIndex(latency)];
+    ++m_count;
+
+    m_max = std::max(m_max, latency);
+}
+
+void toccata::LatencyHistogram::Add(const LatencyHistogram &histogram) {
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] += histogram.m_buckets[i];
+    }
+
+    m_count += histogram.m_count;
+    m_max = std::max(m_max, histogram.m_max);
+}
+
+void toccata::LatencyHistogram::Clear() {
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] = 0;
+    }
+
+    m_count = 0;
+    m_max = 0.0;
+}
+
+double toccata::LatencyHistogram::GetPercentile(double fraction) const {
+    if (m_count == 0) return 0.0;
+
+    const long long target = std::max(1LL, (long long)std::ceil(fraction * m_count));
+
+    long long count = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        count += m_buckets[i];
+        if (count >= target) return std::min(GetBucketBound(i), m_max);
+    }
+
+    return m_max;
+}
+
+int toccata::LatencyHistogram::GetBucketIndex(double latency) {
+    if (latency <= FirstBucketBound) return 0;
+
+    const int bucket = (int)std::ceil(std::log2(latency / FirstBucketBound));
+    return std::min(bucket, BucketCount - 1);
+}
+
+double toccata::LatencyHistogram::GetBucketBound(int bucket) {
+    return std::ldexp(FirstBucketBound, bucket);
+}
@@ -1,5 +1,10 @@
 #include "../include/library.h"
 
+#include "../include/match_cache.h"
+
+#include <algorithm>
+#include <unordered_map>
+
 toccata::Library::Library() {
     m_currentBarId = 0;
 }
@@ -53,3 +58,150 @@ toccata::Piece *toccata::Library::GetPiece(int index) const {
 int toccata::Library::GetPieceCount() const {
     return (int)m_pieces.size();
 }
+
+void toccata::Library::CompileReachability() {
+    // Routes with k skips are built from the routes with k - 1 skips of each
+    // successor, so every bar has to be done one skip count at a time
+    for (int skips = 0; skips <= Bar::MaxCompiledSkips; ++skips) {
+        for (Bar *bar : m_bars) {
+            bar->CompileReachability(skips);
+        }
+    }
+}
+
+int toccata::Library::CompileDuplicates() {
+    for (Bar *bar : m_bars) {
+        bar->SetCanonical(bar);
+    }
+
+    struct Group {
+        Bar *Canonical;
+        std::vector<MusicPoint> Content;
+    };
+
+    std::unordered_map<unsigned long long, std::vector<Group>> groups;
+    std::vector<MusicPoint> content;
+    int canonicalCount = 0;
+    for (Bar *bar : m_bars) {
+        const MusicSegment *segment = bar->GetSegment();
+        if (segment == nullptr) {
+            ++canonicalCount;
+            continue;
+        }
+
+        GetContent(segment, &content);
+
+        // Collisions are told apart by comparing the notes
+        std::vector<Group> &candidates = groups[HashContent(segment, content)];
+
+        Bar *canonical = nullptr;
+        for (const Group &group : candidates) {
+            if (IsSameContent(group.Canonical->GetSegment(), segment, group.Content, content)) {
+                canonical = group.Canonical;
+                break;
+            }
+        }
+
+        if (canonical == nullptr) {
+            candidates.push_back({ bar, content });
+            ++canonicalCount;
+        }
+        else {
+            bar->SetCanonical(canonical);
+            bar->SetSegment(canonical->GetSegment());
+        }
+    }
+
+    return canonicalCount;
+}
+
+void toccata::Library::CompileSummaries() {
+    std::vector<int> pitchCounts;
+    for (Bar *bar : m_bars) {
+        const MusicSegment *segment = bar->GetSegment();
+        if (segment == nullptr) continue;
+
+        const MusicPoint *points = segment->NoteContainer.GetPoints();
+        const int n = segment->NoteContainer.GetCount();
+
+        Bar::Summary summary;
+        summary.Valid = true;
+
+        const TempoEstimator::Estimate estimate = m_tempoEstimator.EstimateTatum(segment, 0, n - 1);
+        if (estimate.Valid) {
+            summary.Tatum = estimate.Tatum;
+            summary.TatumConfidence = estimate.Confidence;
+        }
+
+        pitchCounts.assign(MaxPitches, 0);
+        for (int i = 0; i < n; ++i) {
+            if (points[i].Pitch < MaxPitches) ++pitchCounts[points[i].Pitch];
+        }
+
+        for (int pitch = 0; pitch < MaxPitches; ++pitch) {
+            if (pitchCounts[pitch] > 0) {
+                summary.Pitches.push_back({ (unsigned short)pitch, (unsigned short)pitchCounts[pitch] });
+            }
+        }
+
+        bar->SetSummary(summary);
+    }
+}
+
+void toccata::Library::GetContent(const MusicSegment *segment, std::vector<MusicPoint> *content) {
+    const MusicPoint *points = segment->NoteContainer.GetPoints();
+    content->assign(points, points + segment->NoteContainer.GetCount());
+
+    // Notes are only sorted by time, so the order within a chord depends
+    // on the order they were added in
+    std::sort(content->begin(), content->end(),
+        [](const MusicPoint &a, const MusicPoint &b) {
+            if (a.Timestamp != b.Timestamp) return a.Timestamp < b.Timestamp;
+            else if (a.Pitch != b.Pitch) return a.Pitch < b.Pitch;
+            else if (a.Length != b.Length) return a.Length < b.Length;
+            else if (a.Velocity != b.Velocity) return a.Velocity < b.Velocity;
+            else return a.Part < b.Part;
+        });
+}
+
+unsigned long long toccata::Library::HashContent(
+    const MusicSegment *segment, const std::vector<MusicPoint> &content)
+{
+    // 64-bit FNV-1a
+    unsigned long long hash = 14695981039346656037ull;
+
+    hash = MatchCache::Combine(hash, (unsigned long long)segment->Length);
+    hash = MatchCache::Combine(hash, (unsigned long long)content.size());
+
+    for (const MusicPoint &point : content) {
+        hash = MatchCache::Combine(hash, (unsigned long long)point.Timestamp);
+        hash = MatchCache::Combine(hash, (unsigned long long)point.Pitch);
+        hash = MatchCache::Combine(hash, (unsigned long long)point.Length);
+        hash = MatchCache::Combine(hash, (unsigned long long)point.Velocity);
+    }
+
+    return hash;
+}
+
+bool toccata::Library::IsSameContent(
+    const MusicSegment *a,
+    const MusicSegment *b,
+    const std::vector<MusicPoint> &contentA,
+    const std::vector<MusicPoint> &contentB)
+{
+    if (a->Length != b->Length || a->PulseUnit != b->PulseUnit) return false;
+    else if (contentA.size() != contentB.size()) return false;
+
+    for (size_t i = 0; i < contentA.size(); ++i) {
+        const MusicPoint &p = contentA[i];
+        const MusicPoint &q = contentB[i];
+
+        if (p.Timestamp != q.Timestamp) return false;
+        else if (p.Pitch != q.Pitch) return false;
+        else if (p.Length != q.Length) return false;
+        else if (p.Velocity != q.Velocity) return false;
+        else if (p.Part != q.Part) return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,368 @@
+#include "../include/library_file.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    constexpr char Magic[4] = { 'T', 'L', 'I', 'B' };
+
+    // Keeps every section aligned for the widest field it holds
+    uint64_t Align(uint64_t offset) {
+        return (offset + 7) & ~(uint64_t)7;
+    }
+
+    template<typename T>
+    void WriteSection(std::ofstream &file, const std::vector<T> &data, uint64_t offset) {
+        file.seekp((std::streamoff)offset);
+        if (!data.empty()) {
+            file.write(reinterpret_cast<const char *>(data.data()), sizeof(T) * data.size());
+        }
+    }
+
+} /* namespace */
+
+toccata::LibraryFile::LibraryFile() {
+    m_data = nullptr;
+    m_size = 0;
+
+#if defined(_WIN32)
+    m_file = nullptr;
+    m_mapping = nullptr;
+#endif
+}
+
+toccata::LibraryFile::~LibraryFile() {
+    Close();
+}
+
+bool toccata::LibraryFile::Write(const Library *library, const char *fname) {
+    std::vector<PieceRecord> pieces;
+    std::vector<SegmentRecord> segments;
+    std::vector<BarRecord> bars;
+    std::vector<int32_t> links;
+    std::vector<MusicPoint> notes;
+    std::vector<PitchRecord> pitches;
+    std::string strings;
+
+    std::unordered_map<const Piece *, int> pieceIndices;
+    for (int i = 0; i < library->GetPieceCount(); ++i) {
+        const Piece *piece = library->GetPiece(i);
+        const std::string name = piece->GetName();
+
+        pieceIndices[piece] = i;
+        pieces.push_back({ (uint32_t)strings.size(), (uint32_t)name.size() });
+        strings += name;
+    }
+
+    std::unordered_map<const MusicSegment *, int> segmentIndices;
+    for (int i = 0; i < library->GetSegmentCount(); ++i) {
+        const MusicSegment *segment = library->GetSegment(i);
+        const MusicPoint *points = segment->NoteContainer.GetPoints();
+        const int n = segment->NoteContainer.GetCount();
+
+        // Pitches index per-pitch tables in the solver
+        for (int j = 0; j < n; ++j) {
+            if (points[j].Pitch >= Library::MaxPitches) return false;
+        }
+
+        segmentIndices[segment] = i;
+        segments.push_back(
+            { segment->PulseUnit, segment->PulseRate, segment->Length, (uint32_t)notes.size(), (uint32_t)n });
+        notes.insert(notes.end(), points, points + n);
+    }
+
+    // Bars are written in library order, which is also the order of their ids
+    std::unordered_map<const Bar *, int> barIndices;
+    for (int i = 0; i < library->GetBarCount(); ++i) {
+        barIndices[library->GetBar(i)] = i;
+    }
+
+    for (int i = 0; i < library->GetBarCount(); ++i) {
+        const Bar *bar = library->GetBar(i);
+
+        BarRecord record;
+        record.Segment = (bar->GetSegment() != nullptr) ? segmentIndices.at(bar->GetSegment()) : -1;
+        record.Piece = (bar->GetPiece() != nullptr) ? pieceIndices.at(bar->GetPiece()) : -1;
+        record.Index = bar->GetIndex();
+        record.Canonical = barIndices.at(bar->GetCanonical());
+        record.FirstLink = (uint32_t)links.size();
+        record.LinkCount = (uint32_t)bar->GetNextCount();
+
+        const Bar::Summary &summary = bar->GetSummary();
+        record.SummaryValid = summary.Valid ? 1 : 0;
+        record.FirstPitch = (uint32_t)pitches.size();
+        record.PitchCount = (uint32_t)summary.Pitches.size();
+        record.Tatum = summary.Tatum;
+        record.TatumConfidence = summary.TatumConfidence;
+        bars.push_back(record);
+
+        for (const Bar::PitchCount &pitch : summary.Pitches) {
+            pitches.push_back({ pitch.Pitch, pitch.Count });
+        }
+
+        for (int j = 0; j < bar->GetNextCount(); ++j) {
+            links.push_back(barIndices.at(bar->GetNext(j)));
+        }
+    }
+
+    Header header;
+    memcpy(header.Magic, Magic, sizeof(Magic));
+    header.Version = Version;
+    header.PointSize = sizeof(MusicPoint);
+    header.PieceCount = (uint32_t)pieces.size();
+    header.SegmentCount = (uint32_t)segments.size();
+    header.BarCount = (uint32_t)bars.size();
+    header.LinkCount = (uint32_t)links.size();
+    header.NoteCount = (uint32_t)notes.size();
+    header.PitchCount = (uint32_t)pitches.size();
+    header.StringSize = (uint32_t)strings.size();
+
+    header.PieceOffset = Align(sizeof(Header));
+    header.SegmentOffset = Align(header.PieceOffset + sizeof(PieceRecord) * pieces.size());
+    header.BarOffset = Align(header.SegmentOffset + sizeof(SegmentRecord) * segments.size());
+    header.LinkOffset = Align(header.BarOffset + sizeof(BarRecord) * bars.size());
+    header.NoteOffset = Align(header.LinkOffset + sizeof(int32_t) * links.size());
+    header.PitchOffset = Align(header.NoteOffset + sizeof(MusicPoint) * notes.size());
+    header.StringOffset = Align(header.PitchOffset + sizeof(PitchRecord) * pitches.size());
+
+    std::ofstream file(fname, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    WriteSection(file, pieces, header.PieceOffset);
+    WriteSection(file, segments, header.SegmentOffset);
+    WriteSection(file, bars, header.BarOffset);
+    WriteSection(file, links, header.LinkOffset);
+    WriteSection(file, notes, header.NoteOffset);
+    WriteSection(file, pitches, header.PitchOffset);
+
+    // Seeking past the end doesn't extend the file, so trailing empty
+    // sections are padded
+    file.seekp(0, std::ios::end);
+    for (std::streamoff size = file.tellp(); size < (std::streamoff)header.StringOffset; ++size) {
+        file.put(0);
+    }
+
+    file.seekp((std::streamoff)header.StringOffset);
+    file.write(strings.data(), strings.size());
+
+    return file.good();
+}
+
+bool toccata::LibraryFile::Open(const char *fname) {
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(
+        fname, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_size = (size_t)size.QuadPart;
+#else
+    const int file = open(fname, O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return false;
+    }
+
+    void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    close(file);
+    if (data == MAP_FAILED) return false;
+
+    m_size = (size_t)info.st_size;
+#endif
+
+    m_data = static_cast<const char *>(data);
+
+    if (!Validate()) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void toccata::LibraryFile::Close() {
+    if (m_data == nullptr) return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+    CloseHandle((HANDLE)m_mapping);
+    CloseHandle((HANDLE)m_file);
+
+    m_file = nullptr;
+    m_mapping = nullptr;
+#else
+    munmap((void *)m_data, m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool toccata::LibraryFile::Validate() const {
+    if (m_size < sizeof(Header)) return false;
+
+    const Header *header = GetSection<Header>(0);
+    if (memcmp(header->Magic, Magic, sizeof(Magic)) != 0) return false;
+    else if (header->Version != Version) return false;
+    else if (header->PointSize != sizeof(MusicPoint)) return false;
+
+    const auto fits = [this](uint64_t offset, uint64_t size) {
+        return offset % 8 == 0 && offset <= m_size && size <= m_size - offset;
+    };
+
+    if (!fits(header->PieceOffset, sizeof(PieceRecord) * (uint64_t)header->PieceCount)) return false;
+    else if (!fits(header->SegmentOffset, sizeof(SegmentRecord) * (uint64_t)header->SegmentCount)) return false;
+    else if (!fits(header->BarOffset, sizeof(BarRecord) * (uint64_t)header->BarCount)) return false;
+    else if (!fits(header->LinkOffset, sizeof(int32_t) * (uint64_t)header->LinkCount)) return false;
+    else if (!fits(header->NoteOffset, sizeof(MusicPoint) * (uint64_t)header->NoteCount)) return false;
+    else if (!fits(header->PitchOffset, sizeof(PitchRecord) * (uint64_t)header->PitchCount)) return false;
+    else if (!fits(header->StringOffset, header->StringSize)) return false;
+
+    // Indices are checked once here so that Load can trust them
+    const PieceRecord *pieces = GetSection<PieceRecord>(header->PieceOffset);
+    for (uint32_t i = 0; i < header->PieceCount; ++i) {
+        if ((uint64_t)pieces[i].NameOffset + pieces[i].NameLength > header->StringSize) return false;
+    }
+
+    const SegmentRecord *segments = GetSection<SegmentRecord>(header->SegmentOffset);
+    for (uint32_t i = 0; i < header->SegmentCount; ++i) {
+        if ((uint64_t)segments[i].FirstNote + segments[i].NoteCount > header->NoteCount) return false;
+    }
+
+    const BarRecord *bars = GetSection<BarRecord>(header->BarOffset);
+    for (uint32_t i = 0; i < header->BarCount; ++i) {
+        if (bars[i].Segment < -1 || bars[i].Segment >= (int64_t)header->SegmentCount) return false;
+        else if (bars[i].Piece < -1 || bars[i].Piece >= (int64_t)header->PieceCount) return false;
+        else if ((uint64_t)bars[i].FirstLink + bars[i].LinkCount > header->LinkCount) return false;
+        else if ((uint64_t)bars[i].FirstPitch + bars[i].PitchCount > header->PitchCount) return false;
+
+        // Groups are headed by their first bar
+        const int32_t canonical = bars[i].Canonical;
+        if (canonical < 0 || canonical > (int64_t)i) return false;
+        else if (bars[canonical].Canonical != canonical) return false;
+        else if (bars[canonical].Segment != bars[i].Segment) return false;
+    }
+
+    const int32_t *links = GetSection<int32_t>(header->LinkOffset);
+    for (uint32_t i = 0; i < header->LinkCount; ++i) {
+        if (links[i] < 0 || links[i] >= (int64_t)header->BarCount) return false;
+    }
+
+    // Pitches index per-pitch tables in the solver. Notes aren't read here
+    // so that opening doesn't page in the whole note section, each segment
+    // is checked the first time it's matched instead.
+    const PitchRecord *pitches = GetSection<PitchRecord>(header->PitchOffset);
+    for (uint32_t i = 0; i < header->PitchCount; ++i) {
+        if (pitches[i].Pitch >= Library::MaxPitches) return false;
+    }
+
+    return true;
+}
+
+bool toccata::LibraryFile::Load(Library *library) const {
+    if (!IsOpen()) return false;
+    else if (library->GetBarCount() > 0 || library->GetSegmentCount() > 0) return false;
+
+    const Header *header = GetSection<Header>(0);
+    const PieceRecord *pieces = GetSection<PieceRecord>(header->PieceOffset);
+    const SegmentRecord *segments = GetSection<SegmentRecord>(header->SegmentOffset);
+    const BarRecord *bars = GetSection<BarRecord>(header->BarOffset);
+    const int32_t *links = GetSection<int32_t>(header->LinkOffset);
+    const PitchRecord *pitches = GetSection<PitchRecord>(header->PitchOffset);
+    const char *strings = GetSection<char>(header->StringOffset);
+
+    // The mapping is read-only, containers copy the notes before any change
+    MusicPoint *notes = const_cast<MusicPoint *>(GetSection<MusicPoint>(header->NoteOffset));
+
+    const int pieceStart = library->GetPieceCount();
+    for (uint32_t i = 0; i < header->PieceCount; ++i) {
+        Piece *piece = library->NewPiece();
+        piece->SetName(std::string(strings + pieces[i].NameOffset, pieces[i].NameLength));
+    }
+
+    for (uint32_t i = 0; i < header->SegmentCount; ++i) {
+        MusicSegment *segment = library->NewSegment();
+        segment->PulseUnit = segments[i].PulseUnit;
+        segment->PulseRate = segments[i].PulseRate;
+        segment->Length = segments[i].Length;
+        segment->NoteContainer.SetView(notes + segments[i].FirstNote, (int)segments[i].NoteCount);
+    }
+
+    for (uint32_t i = 0; i < header->BarCount; ++i) {
+        Bar *bar = library->NewBar();
+        bar->SetIndex(bars[i].Index);
+        bar->SetSegment((bars[i].Segment >= 0) ? library->GetSegment(bars[i].Segment) : nullptr);
+        bar->SetPiece((bars[i].Piece >= 0) ? library->GetPiece(pieceStart + bars[i].Piece) : nullptr);
+
+        if (bars[i].Canonical != (int32_t)i) {
+            bar->SetCanonical(library->GetBar(bars[i].Canonical));
+        }
+
+        if (bars[i].SummaryValid != 0) {
+            Bar::Summary summary;
+            summary.Valid = true;
+            summary.Tatum = bars[i].Tatum;
+            summary.TatumConfidence = bars[i].TatumConfidence;
+            for (uint32_t j = 0; j < bars[i].PitchCount; ++j) {
+                const PitchRecord &pitch = pitches[bars[i].FirstPitch + j];
+                summary.Pitches.push_back({ pitch.Pitch, pitch.Count });
+            }
+
+            bar->SetSummary(summary);
+        }
+    }
+
+    // Reachability is compiled once for the whole library instead of after
+    // every link
+    for (uint32_t i = 0; i < header->BarCount; ++i) {
+        Bar *bar = library->GetBar(i);
+        for (uint32_t j = 0; j < bars[i].LinkCount; ++j) {
+            bar->AddNext(library->GetBar(links[bars[i].FirstLink + j]), false);
+        }
+    }
+
+    library->CompileReachability();
+
+    return true;
+}
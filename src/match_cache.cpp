@@ -0,0 +1,123 @@
+#include "../include/match_cache.h"
+
+#include <algorithm>
+
+toccata::MatchCache::MatchCache() {
+    m_tableCount = 0;
+    m_tableLimit = DefaultTableLimit;
+    m_pass = 0;
+}
+
+toccata::MatchCache::~MatchCache() {
+    /* void */
+}
+
+void toccata::MatchCache::SetBarCount(int barCount) {
+    // Tables are allocated the first time a bar is inserted into
+    if (barCount > (int)m_bars.size()) {
+        m_bars.resize(barCount);
+    }
+}
+
+bool toccata::MatchCache::Find(
+    int bar, int position, unsigned long long fingerprint, Entry *target) const
+{
+    std::lock_guard<std::mutex> lock(GetLock(bar));
+
+    const Table &table = m_bars[bar];
+    if (table.Entries.empty()) return false;
+
+    const Entry &entry = table.Entries[position % SlotsPerBar];
+    if (!entry.Valid || entry.Fingerprint != fingerprint) return false;
+
+    table.LastUsed = m_pass;
+    *target = entry;
+    return true;
+}
+
+void toccata::MatchCache::Store(
+    int bar, int position, unsigned long long fingerprint, const Entry &entry)
+{
+    std::lock_guard<std::mutex> lock(GetLock(bar));
+
+    Table &table = m_bars[bar];
+    if (table.Entries.empty()) {
+        table.Entries.resize(SlotsPerBar);
+        ++m_tableCount;
+    }
+
+    table.LastUsed = m_pass;
+
+    Entry &slot = table.Entries[position % SlotsPerBar];
+    slot = entry;
+    slot.Fingerprint = fingerprint;
+    slot.Valid = true;
+}
+
+void toccata::MatchCache::Trim() {
+    if (m_tableLimit <= 0 || m_tableCount <= m_tableLimit) return;
+
+    std::vector<std::pair<unsigned long long, int>> tables;
+    tables.reserve(m_tableCount);
+    for (int i = 0; i < (int)m_bars.size(); ++i) {
+        if (!m_bars[i].Entries.empty()) tables.push_back({ m_bars[i].LastUsed, i });
+    }
+
+    const int target = m_tableLimit - m_tableLimit / 4;
+    const int excess = (int)tables.size() - target;
+    std::nth_element(tables.begin(), tables.begin() + excess, tables.end());
+
+    for (int i = 0; i < excess; ++i) {
+        Release(tables[i].second);
+    }
+}
+
+void toccata::MatchCache::Release(int bar) {
+    if (bar >= (int)m_bars.size()) return;
+
+    Table &table = m_bars[bar];
+    if (table.Entries.empty()) return;
+
+    std::vector<Entry>().swap(table.Entries);
+    --m_tableCount;
+}
+
+void toccata::MatchCache::Clear() {
+    for (Table &table : m_bars) {
+        for (Entry &entry : table.Entries) {
+            entry.Valid = false;
+        }
+    }
+}
+
+unsigned long long toccata::MatchCache::Fingerprint(const MusicSegment *segment, int start, int end) {
+    // 64-bit FNV-1a over every field the solver reads
+    unsigned long long hash = 14695981039346656037ull;
+
+    auto mix = [&hash](unsigned long long value) {
+        hash = Combine(hash, value);
+    };
+
+    mix((unsigned long long)(end - start + 1));
+
+    const MusicPoint *points = segment->NoteContainer.GetPoints();
+    for (int i = start; i <= end; ++i) {
+        mix((unsigned long long)points[i].Timestamp);
+        mix((unsigned long long)points[i].Pitch);
+        mix((unsigned long long)points[i].Length);
+        mix((unsigned long long)points[i].Velocity);
+    }
+
+    return hash;
+}
+
+unsigned long long toccata::MatchCache::Combine(unsigned long long hash, unsigned long long value) {
+    constexpr unsigned long long Prime = 1099511628211ull;
+
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= Prime;
+    }
+
+    return hash;
+}
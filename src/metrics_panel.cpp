@@ -6,6 +6,7 @@
 
 toccata::MetricsPanel::MetricsPanel() {
     m_decisionThread = nullptr;
+    m_residency = nullptr;
 }
 
 toccata::MetricsPanel::~MetricsPanel() {
@@ -24,10 +25,26 @@ void toccata::MetricsPanel::Render() {
     RenderText("Current", grid.GetRange(1, 1, 2, 2), 15.0f, 5.0f);
     RenderText("Target", grid.GetRange(2, 2, 2, 2), 15.0f, 5.0f);
     RenderText("Threads", grid.GetRange(3, 3, 4, 4), 15.0f, 5.0f);
+    RenderText("Idle", grid.GetRange(3, 3, 1, 1), 15.0f, 5.0f);
+    RenderText("Wake", grid.GetRange(3, 3, 0, 0), 15.0f, 5.0f);
+    RenderText("Cache", grid.GetRange(3, 3, 2, 2), 15.0f, 5.0f);
+    RenderText("Saved", grid.GetRange(3, 3, 3, 3), 15.0f, 5.0f);
+    RenderText("Stages", grid.GetRange(0, 0, 3, 3), 15.0f, 5.0f);
+    RenderText("Library", grid.GetRange(0, 0, 4, 4), 15.0f, 5.0f);
 
     const int peakIndex = m_decisionThread->ReadPeakIndex();
     const int peakTargetIndex = m_decisionThread->ReadPeakTargetIndex();
     const double peakLatency = m_decisionThread->ReadPeakLatency();
+    const double peakWakeLatency = m_decisionThread->ReadPeakWakeLatency();
+    const double idlePercentage = m_decisionThread->ReadIdlePercentage();
+    const double cacheHitRate = m_decisionThread->ReadMatchCacheHitRate();
+    const double savedSolveTime = m_decisionThread->ReadSavedSolveTime();
+    const int peakActiveWorkers = m_decisionThread->ReadPeakActiveWorkers();
+
+    LatencyHistogram stageLatency[DecisionThread::StageCount];
+    for (int i = 0; i < DecisionThread::StageCount; ++i) {
+        stageLatency[i] = m_decisionThread->ReadStageLatency((DecisionThread::Stage)i);
+    }
 
     std::stringstream ss;
     ss << peakIndex;
@@ -52,6 +69,52 @@ void toccata::MetricsPanel::Render() {
     ss.precision(2);
     ss << std::fixed << targetLatency;
     RenderText(ss.str(), grid.GetRange(2, 2, 0, 0), 20.0f, 5.0f);
+
+    ss = std::stringstream();
+    ss.precision(1);
+    ss << std::fixed << idlePercentage << " %";
+    RenderText(ss.str(), grid.GetRange(4, 4, 1, 1), 20.0f, 5.0f);
+
+    ss = std::stringstream();
+    ss.precision(2);
+    ss << std::fixed << peakWakeLatency * 1000.0 << " ms";
+    RenderText(ss.str(), grid.GetRange(4, 4, 0, 0), 20.0f, 5.0f);
+
+    ss = std::stringstream();
+    ss.precision(1);
+    ss << std::fixed << cacheHitRate * 100.0 << " %";
+    RenderText(ss.str(), grid.GetRange(4, 4, 2, 2), 20.0f, 5.0f);
+
+    ss = std::stringstream();
+    ss.precision(2);
+    ss << std::fixed << savedSolveTime << " s";
+    RenderText(ss.str(), grid.GetRange(4, 4, 3, 3), 20.0f, 5.0f);
+
+    ss = std::stringstream();
+    ss << peakActiveWorkers << " / " << m_decisionThread->GetMaximumWorkers();
+    RenderText(ss.str(), grid.GetRange(4, 4, 4, 4), 20.0f, 5.0f);
+
+    // 95th percentile of ingest / match / integrate / publish
+    ss = std::stringstream();
+    ss.precision(2);
+    ss << std::fixed;
+    for (int i = 0; i < DecisionThread::StageCount; ++i) {
+        if (i > 0) ss << " / ";
+        ss << stageLatency[i].GetPercentile(0.95) * 1000.0;
+    }
+    ss << " ms";
+    RenderText(ss.str(), grid.GetRange(1, 2, 3, 3), 20.0f, 5.0f);
+
+    // Hit rate of the resident pieces and the memory they use
+    if (m_residency != nullptr) {
+        const ResidencyManager::Statistics residency = m_residency->GetStatistics();
+
+        ss = std::stringstream();
+        ss.precision(1);
+        ss << std::fixed << residency.GetHitRate() * 100.0 << " % / "
+            << residency.ResidentBytes / (1024.0 * 1024.0) << " MB";
+        RenderText(ss.str(), grid.GetRange(1, 2, 4, 4), 20.0f, 5.0f);
+    }
 }
 
 void toccata::MetricsPanel::Update() {
@@ -1,5 +1,7 @@
 #include "../include/midi_handler.h"
 
+#include "../include/decision_thread.h"
+
 toccata::MidiHandler *toccata::MidiHandler::s_handler = nullptr;
 
 toccata::MidiHandler::MidiHandler() {
@@ -13,6 +15,9 @@ toccata::MidiHandler::MidiHandler() {
 
     m_timestampOffset = 0;
     m_lastTimestamp = 0;
+
+    m_decisionThread = nullptr;
+    m_deferredNoteCount = 0;
 }
 
 toccata::MidiHandler::~MidiHandler() {
@@ -25,9 +30,54 @@ toccata::MidiHandler *toccata::MidiHandler::Get() {
     return s_handler;
 }
 
+void toccata::MidiHandler::SetDecisionThread(DecisionThread *thread) {
+    m_bufferLock.lock();
+
+    m_deferredNotes.clear();
+    m_decisionThread = thread;
+
+    if (m_decisionThread != nullptr) {
+        const int noteCount = m_buffer.GetNoteCount();
+        for (int i = 0; i < noteCount; ++i) {
+            const MidiNote &note = m_buffer.GetNote(i);
+            if (note.Valid) SendNote(note);
+        }
+    }
+
+    m_bufferLock.unlock();
+}
+
+void toccata::MidiHandler::SendNote(const MidiNote &note) {
+    MusicPoint point;
+    point.Pitch = note.MidiKey;
+    point.Timestamp = note.Timestamp;
+    point.Velocity = note.Velocity;
+    point.Length = note.NoteLength;
+
+    // Notes have to reach the thread in the same order as the UI sees
+    // them, so nothing jumps ahead of a deferred note
+    if (!m_deferredNotes.empty() || !m_decisionThread->AddNote(point)) {
+        m_deferredNotes.push_back(point);
+        ++m_deferredNoteCount;
+    }
+}
+
+void toccata::MidiHandler::FlushDeferredNotes() {
+    if (m_decisionThread == nullptr) return;
+
+    size_t sent = 0;
+    for (; sent < m_deferredNotes.size(); ++sent) {
+        if (!m_decisionThread->AddNote(m_deferredNotes[sent])) break;
+    }
+
+    m_deferredNotes.erase(m_deferredNotes.begin(), m_deferredNotes.begin() + sent);
+}
+
 void toccata::MidiHandler::Extract(MidiStream *targetBuffer, MidiStream *unresolvedBuffer) {
     m_bufferLock.lock();
 
+    FlushDeferredNotes();
+
     const int noteCount = m_buffer.GetNoteCount();
     for (int i = 0; i < noteCount; ++i) {
         const MidiNote &note = m_buffer.GetNote(i);
@@ -57,7 +107,15 @@ void toccata::MidiHandler::ProcessEvent(int status, int midiByte1, int midiByte2
     m_lastTimestamp = timestamp;
     m_lastTimestampSystemTime = std::chrono::system_clock::now();
 
-    m_buffer.ProcessMidiEvent(status, midiByte1, midiByte2, timestamp + m_timestampOffset);
+    const int completedNote =
+        m_buffer.ProcessMidiEvent(status, midiByte1, midiByte2, timestamp + m_timestampOffset);
+
+    // Events from every input are serialized by the buffer lock, so the
+    // decision thread only ever sees a single producer
+    if (completedNote != -1 && m_decisionThread != nullptr) {
+        FlushDeferredNotes();
+        SendNote(m_buffer.GetNote(completedNote));
+    }
 
     m_bufferLock.unlock();
 }
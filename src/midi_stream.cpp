@@ -71,7 +71,7 @@ toccata::MidiStream::MidiEvent toccata::MidiStream::GetEvent(int index) const {
     return m_events[index];
 }
 
-void toccata::MidiStream::ProcessMidiEvent(
+int toccata::MidiStream::ProcessMidiEvent(
     int status,
     int byte1,
     int byte2,
@@ -117,9 +117,13 @@ void toccata::MidiStream::ProcessMidiEvent(
                 newEvent.Key = key;
 
                 m_events.push_back(newEvent);
+
+                return lastNote;
             }
         }
     }
+
+    return -1;
 }
 
 int toccata::MidiStream::GetPreviousNote(unsigned int midiNote, timestamp t) {
@@ -1,6 +1,7 @@
 #include "../include/munkres_solver.h"
 
 #include "../include/memory.h"
+#include "../include/thread_utilities.h"
 
 void toccata::MunkresSolver::AllocateMemorySpace(Request::MemorySpace *memory, int n, int m) {
     memory->ColumnCover = Memory::Allocate<bool>(m);
@@ -82,6 +83,20 @@ void toccata::MunkresSolver::FreeMemorySpace(Request::MemorySpace *memory) {
     Memory::Free2d(memory->D);
 }
 
+bool toccata::MunkresSolver::LockMemorySpace(Request::MemorySpace *memory, int n, int m) {
+    bool locked = true;
+    locked = ThreadUtilities::Lock(memory->ColumnCover, m) && locked;
+    locked = ThreadUtilities::Lock(memory->RowCover, n) && locked;
+
+    locked = ThreadUtilities::Lock2d(memory->Path, 2) && locked;
+    locked = ThreadUtilities::Lock2d(memory->Starred, m) && locked;
+
+    locked = ThreadUtilities::Lock2d(memory->C, m) && locked;
+    locked = ThreadUtilities::Lock2d(memory->D, m) && locked;
+
+    return locked;
+}
+
 toccata::MunkresSolver::Step toccata::MunkresSolver::DoStep_1(Request *request) {
     for (int i = 0; i < request->n; ++i) {
         int smallest = 0;
@@ -3,6 +3,7 @@
 #include "../include/math.h"
 #include "../include/transform.h"
 #include "../include/memory.h"
+#include "../include/thread_utilities.h"
 
 int toccata::NoteMapper::GetClosestNote(
     const MusicSegment *segment, const Transform &coarse, int start, int end, double timestamp, int pitch)
@@ -154,6 +155,21 @@ void toccata::NoteMapper::FreeMemorySpace(
     MunkresSolver::FreeMemorySpace(&memory->MunkresMemory);
 }
 
+bool toccata::NoteMapper::LockMemorySpace(
+    InjectiveMappingRequest::MemorySpace *memory, int referenceNoteCount, int noteCount)
+{
+    const int n = referenceNoteCount;
+    const int m = noteCount;
+    const int k = m > n ? m : n;
+
+    bool locked = true;
+    locked = ThreadUtilities::Lock2d(memory->Costs, k) && locked;
+    locked = ThreadUtilities::Lock2d(memory->Disallowed, k) && locked;
+    locked = MunkresSolver::LockMemorySpace(&memory->MunkresMemory, n, k) && locked;
+
+    return locked;
+}
+
 int *toccata::NoteMapper::GetInjectiveMapping(InjectiveMappingRequest *request) {
     assert(request->Start >= 0);
     assert(request->End >= request->Start);
@@ -0,0 +1,212 @@
+#include "../include/residency_manager.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <stdint.h>
+
+#include <set>
+#include <unordered_map>
+
+namespace {
+
+    size_t GetPageSize() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        return (size_t)info.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    // Ranges are widened to whole pages, so a page shared with a piece
+    // that is still resident can be dropped too. It's paged back in the
+    // next time it's read.
+    void Advise(const char *begin, size_t size, bool willNeed) {
+        static const size_t pageSize = GetPageSize();
+
+        const uintptr_t start = (uintptr_t)begin & ~(uintptr_t)(pageSize - 1);
+        const uintptr_t end = ((uintptr_t)begin + size + pageSize - 1) & ~(uintptr_t)(pageSize - 1);
+        const size_t length = (size_t)(end - start);
+
+#if defined(_WIN32)
+        if (willNeed) {
+#if _WIN32_WINNT >= 0x0602
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = (PVOID)start;
+            range.NumberOfBytes = length;
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+            volatile char sink = 0;
+            for (uintptr_t page = start; page < end; page += pageSize) {
+                sink += *(const volatile char *)page;
+            }
+#endif
+        }
+        else {
+            // Removes pages that aren't locked from the working set
+            VirtualUnlock((LPVOID)start, length);
+        }
+#else
+        madvise((void *)start, length, willNeed ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+    }
+
+} /* namespace */
+
+toccata::ResidencyManager::ResidencyManager() {
+    m_budget = 0;
+}
+
+toccata::ResidencyManager::~ResidencyManager() {
+    /* void */
+}
+
+void toccata::ResidencyManager::Initialize(const Library *library, size_t budget) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_groups.clear();
+    m_recent.clear();
+    m_evicted.clear();
+    m_statistics = Statistics();
+    m_budget = budget;
+
+    const int barCount = library->GetBarCount();
+    m_barGroups.assign(barCount, -1);
+
+    std::unordered_map<const Piece *, int> pieceGroups;
+    std::set<std::pair<int, const MusicSegment *>> added;
+    for (int i = 0; i < barCount; ++i) {
+        const Bar *bar = library->GetBar(i);
+        const Piece *piece = bar->GetPiece();
+
+        int group;
+        if (piece != nullptr && pieceGroups.count(piece) > 0) {
+            group = pieceGroups[piece];
+        }
+        else {
+            group = (int)m_groups.size();
+            m_groups.emplace_back();
+
+            if (piece != nullptr) pieceGroups[piece] = group;
+        }
+
+        m_barGroups[bar->GetId()] = group;
+        m_groups[group].Bars.push_back(bar->GetId());
+
+        // Notes that were copied onto the heap can't be paged out
+        const MusicSegment *segment = bar->GetSegment();
+        if (segment == nullptr || !segment->NoteContainer.IsView()) continue;
+        else if (segment->NoteContainer.GetCount() == 0) continue;
+        else if (!added.insert({ group, segment }).second) continue;
+
+        Range range;
+        range.Begin = (const char *)segment->NoteContainer.GetPoints();
+        range.Size = sizeof(MusicPoint) * segment->NoteContainer.GetCount();
+
+        m_groups[group].Ranges.push_back(range);
+        m_groups[group].Bytes += range.Size;
+    }
+}
+
+void toccata::ResidencyManager::SetBudget(size_t budget) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_budget = budget;
+    EvictOver(-1);
+}
+
+bool toccata::ResidencyManager::Touch(const Bar *bar) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    const int group = m_barGroups[bar->GetId()];
+    const bool hit = m_groups[group].Resident;
+    if (hit) ++m_statistics.Hits;
+    else ++m_statistics.Misses;
+
+    MakeResident(group, false);
+
+    return hit;
+}
+
+void toccata::ResidencyManager::Prefetch(const Bar *bar) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    MakeResident(m_barGroups[bar->GetId()], true);
+}
+
+bool toccata::ResidencyManager::IsResident(const Bar *bar) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    return m_groups[m_barGroups[bar->GetId()]].Resident;
+}
+
+void toccata::ResidencyManager::DrainEvicted(std::vector<int> *bars) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (int group : m_evicted) {
+        bars->insert(bars->end(), m_groups[group].Bars.begin(), m_groups[group].Bars.end());
+    }
+
+    m_evicted.clear();
+}
+
+toccata::ResidencyManager::Statistics toccata::ResidencyManager::GetStatistics() {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    return m_statistics;
+}
+
+void toccata::ResidencyManager::MakeResident(int group, bool prefetch) {
+    Group &target = m_groups[group];
+
+    if (target.Resident) {
+        m_recent.splice(m_recent.begin(), m_recent, target.Position);
+        return;
+    }
+
+    if (prefetch) ++m_statistics.Prefetches;
+
+    for (const Range &range : target.Ranges) {
+        Advise(range.Begin, range.Size, true);
+    }
+
+    m_recent.push_front(group);
+    target.Position = m_recent.begin();
+    target.Resident = true;
+
+    m_statistics.ResidentBytes += target.Bytes;
+    ++m_statistics.ResidentPieces;
+
+    EvictOver(group);
+}
+
+void toccata::ResidencyManager::EvictOver(int keep) {
+    if (m_budget == 0) return;
+
+    // The piece that was just made resident is kept even if it doesn't
+    // fit on its own
+    while (m_statistics.ResidentBytes > m_budget && !m_recent.empty()) {
+        const int victim = m_recent.back();
+        if (victim == keep) break;
+
+        Group &evicted = m_groups[victim];
+        for (const Range &range : evicted.Ranges) {
+            Advise(range.Begin, range.Size, false);
+        }
+
+        m_recent.pop_back();
+        m_evicted.push_back(victim);
+        evicted.Resident = false;
+
+        m_statistics.ResidentBytes -= evicted.Bytes;
+        --m_statistics.ResidentPieces;
+        ++m_statistics.Evictions;
+    }
+}
@@ -0,0 +1,92 @@
+#include "../include/tempo_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+toccata::TempoEstimator::TempoEstimator() {
+    /* void */
+}
+
+toccata::TempoEstimator::~TempoEstimator() {
+    /* void */
+}
+
+toccata::TempoEstimator::Estimate toccata::TempoEstimator::EstimateTatum(
+    const MusicSegment *segment, int start, int end)
+{
+    Estimate estimate;
+
+    const int noteCount = segment->NoteContainer.GetCount();
+    start = std::max(start, 0);
+    end = std::min(end, noteCount - 1);
+    if (end - start < 2) return estimate;
+
+    const MusicPoint *points = segment->NoteContainer.GetPoints();
+
+    m_sorted.clear();
+    for (int i = start + 1; i <= end; ++i) {
+        m_sorted.push_back(segment->Normalize(points[i].Timestamp - points[i - 1].Timestamp));
+    }
+
+    std::sort(m_sorted.begin(), m_sorted.end());
+    const double chordInterval = ChordFraction * m_sorted[(m_sorted.size() * 3) / 4];
+
+    // Notes of a chord are merged into the first one's onset
+    m_onsets.clear();
+    m_onsets.push_back(segment->Normalize(points[start].Timestamp));
+    for (int i = start + 1; i <= end; ++i) {
+        const double onset = segment->Normalize(points[i].Timestamp);
+        if (onset - m_onsets.back() > chordInterval) {
+            m_onsets.push_back(onset);
+        }
+    }
+
+    m_intervals.clear();
+    for (size_t i = 1; i < m_onsets.size(); ++i) {
+        m_intervals.push_back(m_onsets[i] - m_onsets[i - 1]);
+    }
+
+    if (m_intervals.empty()) return estimate;
+
+    // Every observed interval is a candidate. Shorter candidates explain
+    // more intervals, so the tatum wins over its multiples.
+    double bestScore = 0.0;
+    double bestTatum = 0.0;
+    for (double candidate : m_intervals) {
+        double score = 0.0;
+        for (double interval : m_intervals) {
+            const double ratio = interval / candidate;
+            const double multiple = std::round(ratio);
+            if (multiple < 1 || multiple > MaxMultiple) continue;
+
+            const double error = (ratio / multiple - 1.0) / Deviation;
+            score += std::exp(-0.5 * error * error);
+        }
+
+        if (score > bestScore) {
+            bestScore = score;
+            bestTatum = candidate;
+        }
+    }
+
+    estimate.Valid = bestTatum > 0.0;
+    estimate.Tatum = bestTatum;
+    estimate.Confidence = bestScore / m_intervals.size();
+
+    return estimate;
+}
+
+bool toccata::TempoEstimator::IsConsistent(
+    double referenceTatum, double inputTatum, double s, double tolerance)
+{
+    if (referenceTatum <= 0.0 || inputTatum <= 0.0 || s <= 0.0) return true;
+
+    // Reference time is s times input time
+    const double ratio = (referenceTatum / s) / inputTatum;
+    const double x = (ratio >= 1.0) ? ratio : 1.0 / ratio;
+
+    const double multiple = std::round(x);
+    if (multiple > MaxMultiple) return false;
+
+    return std::abs(x / multiple - 1.0) <= tolerance;
+}
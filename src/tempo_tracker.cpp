@@ -0,0 +1,96 @@
+#include "../include/tempo_tracker.h"
+
+toccata::TempoTracker::TempoTracker() {
+    Reset();
+}
+
+toccata::TempoTracker::~TempoTracker() {
+    /* void */
+}
+
+void toccata::TempoTracker::Reset() {
+    m_valid = false;
+    m_boundary = 0.0;
+    m_period = 1.0;
+
+    m_covariance[0][0] = m_covariance[1][1] = 0.0;
+    m_covariance[0][1] = m_covariance[1][0] = 0.0;
+}
+
+void toccata::TempoTracker::Initialize(double boundary, double period) {
+    m_valid = true;
+    m_boundary = boundary;
+    m_period = period;
+
+    const double boundaryNoise = BoundaryNoise * period;
+    const double periodNoise = PeriodNoise * period;
+
+    m_covariance[0][0] = boundaryNoise * boundaryNoise;
+    m_covariance[1][1] = periodNoise * periodNoise;
+    m_covariance[0][1] = m_covariance[1][0] = 0.0;
+}
+
+void toccata::TempoTracker::Predict(double barLength) {
+    // x' = F x with F = [1 L; 0 1]
+    m_boundary += barLength * m_period;
+
+    const double p00 = m_covariance[0][0];
+    const double p01 = m_covariance[0][1];
+    const double p11 = m_covariance[1][1];
+
+    const double boundaryDrift = BoundaryDrift * barLength * m_period;
+    const double periodDrift = PeriodDrift * m_period;
+
+    // P' = F P F^T + Q
+    m_covariance[0][0] = p00 + 2 * barLength * p01 + barLength * barLength * p11
+        + boundaryDrift * boundaryDrift;
+    m_covariance[0][1] = m_covariance[1][0] = p01 + barLength * p11;
+    m_covariance[1][1] = p11 + periodDrift * periodDrift;
+}
+
+void toccata::TempoTracker::Update(double boundary, double period) {
+    if (!m_valid) {
+        Initialize(boundary, period);
+        return;
+    }
+
+    const double boundaryNoise = BoundaryNoise * m_period;
+    const double periodNoise = PeriodNoise * m_period;
+
+    // Both components are measured directly, so H = I and S = P + R
+    const double s00 = m_covariance[0][0] + boundaryNoise * boundaryNoise;
+    const double s01 = m_covariance[0][1];
+    const double s11 = m_covariance[1][1] + periodNoise * periodNoise;
+
+    const double determinant = s00 * s11 - s01 * s01;
+    if (determinant <= 0.0) {
+        Initialize(boundary, period);
+        return;
+    }
+
+    const double i00 = s11 / determinant;
+    const double i01 = -s01 / determinant;
+    const double i11 = s00 / determinant;
+
+    // K = P S^-1
+    const double p00 = m_covariance[0][0];
+    const double p01 = m_covariance[0][1];
+    const double p11 = m_covariance[1][1];
+
+    const double k00 = p00 * i00 + p01 * i01;
+    const double k01 = p00 * i01 + p01 * i11;
+    const double k10 = p01 * i00 + p11 * i01;
+    const double k11 = p01 * i01 + p11 * i11;
+
+    const double y0 = boundary - m_boundary;
+    const double y1 = period - m_period;
+
+    m_boundary += k00 * y0 + k01 * y1;
+    m_period += k10 * y0 + k11 * y1;
+
+    // P = (I - K) P
+    m_covariance[0][0] = (1 - k00) * p00 - k01 * p01;
+    m_covariance[0][1] = (1 - k00) * p01 - k01 * p11;
+    m_covariance[1][0] = m_covariance[0][1];
+    m_covariance[1][1] = -k10 * p01 + (1 - k11) * p11;
+}
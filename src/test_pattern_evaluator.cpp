@@ -3,6 +3,7 @@
 #include "../include/nls_optimizer.h"
 #include "../include/comparator.h"
 #include "../include/memory.h"
+#include "../include/thread_utilities.h"
 
 void toccata::TestPatternEvaluator::AllocateMemorySpace(
     Request::MemorySpace *memory,
@@ -27,6 +28,22 @@ void toccata::TestPatternEvaluator::FreeMemorySpace(Request::MemorySpace *memory
     Memory::Free(memory->Mapping);
 }
 
+bool toccata::TestPatternEvaluator::LockMemorySpace(
+    Request::MemorySpace *memory,
+    int testPatternSize,
+    int referenceSegmentNotes,
+    int segmentNotes)
+{
+    bool locked = NoteMapper::LockMemorySpace(&memory->MappingMemory, referenceSegmentNotes, segmentNotes);
+
+    locked = ThreadUtilities::Lock(memory->Stack, testPatternSize) && locked;
+    locked = ThreadUtilities::Lock(memory->p, referenceSegmentNotes) && locked;
+    locked = ThreadUtilities::Lock(memory->r, referenceSegmentNotes) && locked;
+    locked = ThreadUtilities::Lock(memory->Mapping, referenceSegmentNotes) && locked;
+
+    return locked;
+}
+
 bool toccata::TestPatternEvaluator::Solve(const Request &request, Output *output) {
     const int patternLength = request.TestPatternLength;
 
@@ -55,6 +72,8 @@ bool toccata::TestPatternEvaluator::Solve(const Request &request, Output *output
     bestMatchData.MappingEnd = -1;
     bestMatchData.MappingStart = -1;
 
+    int evaluatedHypotheses = 0;
+
     Transform coarse;
     coarse.s = 0.0;
     coarse.t = 0.0;
@@ -90,6 +109,11 @@ bool toccata::TestPatternEvaluator::Solve(const Request &request, Output *output
 
         bool solvable = NlsOptimizer::Solve(problem, &solution);
         if (!solvable) continue;
+        else if (solution.s < request.MinScale || solution.s > request.MaxScale) continue;
+        else if (!TempoEstimator::IsConsistent(
+            request.ReferenceTatum, request.InputTatum, solution.s, TatumTolerance)) continue;
+
+        ++evaluatedHypotheses;
 
         NoteMapper::NNeighborMappingRequest nnMappingRequest;
         nnMappingRequest.T.s = solution.s;
@@ -156,6 +180,8 @@ bool toccata::TestPatternEvaluator::Solve(const Request &request, Output *output
         }
     }
 
+    output->EvaluatedHypotheses = evaluatedHypotheses;
+
     if (bestMatchData.MappedNotes == 0) return false;
     else {
         output->AverageError = bestMatchData.AverageError;
@@ -0,0 +1,105 @@
+#include "../include/thread_utilities.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace {
+
+    size_t GetPageSize() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        return (size_t)info.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+} /* namespace */
+
+bool toccata::ThreadUtilities::SetAffinity(unsigned long long cpuMask) {
+    if (cpuMask == 0) return true;
+
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)cpuMask) != 0;
+#else
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    for (int i = 0; i < 64 && i < CPU_SETSIZE; ++i) {
+        if ((cpuMask & (1ull << i)) != 0) CPU_SET(i, &cpus);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) == 0;
+#endif
+}
+
+bool toccata::ThreadUtilities::SetScheduling(SchedulingPolicy policy, int priority) {
+#if defined(_WIN32)
+    const int threadPriority = (policy == SchedulingPolicy::Default)
+        ? THREAD_PRIORITY_NORMAL
+        : THREAD_PRIORITY_TIME_CRITICAL;
+
+    return SetThreadPriority(GetCurrentThread(), threadPriority) != 0;
+#else
+    int nativePolicy = SCHED_OTHER;
+    if (policy == SchedulingPolicy::Fifo) nativePolicy = SCHED_FIFO;
+    else if (policy == SchedulingPolicy::RoundRobin) nativePolicy = SCHED_RR;
+
+    sched_param parameters;
+    parameters.sched_priority = std::max(
+        sched_get_priority_min(nativePolicy),
+        std::min(priority, sched_get_priority_max(nativePolicy)));
+
+    // Fails with EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO allowance
+    return pthread_setschedparam(pthread_self(), nativePolicy, &parameters) == 0;
+#endif
+}
+
+bool toccata::ThreadUtilities::Apply(const RealtimeSettings &settings) {
+    if (!settings.Enabled) return true;
+
+    // Both are attempted even if the first one fails
+    const bool pinned = SetAffinity(settings.CpuMask);
+    const bool scheduled = (settings.Policy == SchedulingPolicy::Default)
+        ? true
+        : SetScheduling(settings.Policy, settings.Priority);
+
+    return pinned && scheduled;
+}
+
+void toccata::ThreadUtilities::Prefault(void *memory, size_t size) {
+    if (memory == nullptr || size == 0) return;
+
+    const size_t pageSize = GetPageSize();
+    volatile char *bytes = (volatile char *)memory;
+
+    // Writing is what allocates the page, reading would only map a shared
+    // zero page on some systems
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+        bytes[offset] = bytes[offset];
+    }
+
+    bytes[size - 1] = bytes[size - 1];
+}
+
+bool toccata::ThreadUtilities::LockMemory(void *memory, size_t size) {
+    if (memory == nullptr || size == 0) return true;
+
+#if defined(_WIN32)
+    // Limited by the process's minimum working set size
+    return VirtualLock(memory, size) != 0;
+#else
+    // Limited by RLIMIT_MEMLOCK
+    return mlock(memory, size) == 0;
+#endif
+}
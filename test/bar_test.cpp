@@ -0,0 +1,110 @@
+#include <pch.h>
+
+#include "../include/library.h"
+
+namespace {
+
+	toccata::Bar *NewBar(toccata::Library *library, int noteCount) {
+		toccata::MusicSegment *segment = library->NewSegment();
+		segment->PulseUnit = 1.0;
+		segment->Length = 0;
+		for (int i = 0; i < noteCount; ++i) {
+			segment->NoteContainer.AddPoint({ i, 0 });
+		}
+
+		toccata::Bar *bar = library->NewBar();
+		bar->SetSegment(segment);
+
+		return bar;
+	}
+
+} /* namespace */
+
+TEST(BarTest, FindNextMatchesSearchOrder) {
+	toccata::Library library;
+
+	toccata::Bar *a = NewBar(&library, 1);
+	toccata::Bar *b = NewBar(&library, 2);
+	toccata::Bar *c = NewBar(&library, 3);
+	toccata::Bar *d = NewBar(&library, 4);
+
+	a->AddNext(b);
+	a->AddNext(c);
+	b->AddNext(c);
+	c->AddNext(d);
+	d->AddNext(a);
+
+	// Lengths are only known after the bars have been linked
+	a->GetSegment()->Length = 10;
+	b->GetSegment()->Length = 20;
+	c->GetSegment()->Length = 30;
+	d->GetSegment()->Length = 40;
+
+	toccata::Bar::SearchResult result = a->FindNext(c, 0);
+	EXPECT_EQ(result.Offset, 0);
+	EXPECT_DOUBLE_EQ(result.Distance, 0.0);
+
+	// The route through b is found before the direct link
+	result = a->FindNext(c, 1);
+	EXPECT_EQ(result.Offset, 3);
+	EXPECT_DOUBLE_EQ(result.Distance, 10.0);
+
+	result = a->FindNext(d, 2);
+	EXPECT_EQ(result.Offset, 8);
+	EXPECT_DOUBLE_EQ(result.Distance, 30.0);
+
+	result = a->FindNext(d, 0);
+	EXPECT_EQ(result.Offset, -1);
+
+	// Falls back to searching past the compiled skip count
+	result = a->FindNext(a, 3);
+	EXPECT_EQ(result.Offset, 3);
+	EXPECT_DOUBLE_EQ(result.Distance, 60.0);
+}
+
+TEST(BarTest, FindNextUpdatedByAddNext) {
+	toccata::Library library;
+
+	toccata::Bar *a = NewBar(&library, 1);
+	toccata::Bar *b = NewBar(&library, 1);
+	toccata::Bar *c = NewBar(&library, 1);
+
+	a->AddNext(b);
+	EXPECT_EQ(a->FindNext(c, 1).Offset, -1);
+
+	b->AddNext(c);
+	EXPECT_EQ(a->FindNext(c, 1).Offset, 1);
+	EXPECT_EQ(a->FindNext(c, 2).Offset, 1);
+
+	library.CompileReachability();
+	EXPECT_EQ(a->FindNext(c, 1).Offset, 1);
+	EXPECT_EQ(b->FindNext(c, 0).Offset, 0);
+}
+
+TEST(BarTest, CompileDuplicates) {
+	toccata::Library library;
+
+	toccata::Bar *a = NewBar(&library, 3);
+	toccata::Bar *b = NewBar(&library, 4);
+	toccata::Bar *c = NewBar(&library, 3);
+	toccata::Bar *d = NewBar(&library, 3);
+
+	// Same notes at a different pitch
+	d->GetSegment()->NoteContainer.GetPoints()[1].Pitch = 60;
+
+	EXPECT_EQ(library.CompileDuplicates(), 3);
+
+	EXPECT_TRUE(a->IsCanonical());
+	EXPECT_TRUE(b->IsCanonical());
+	EXPECT_TRUE(d->IsCanonical());
+	EXPECT_EQ(c->GetCanonical(), a);
+	EXPECT_EQ(c->GetSegment(), a->GetSegment());
+
+	ASSERT_EQ(a->GetDuplicateCount(), 1);
+	EXPECT_EQ(a->GetDuplicate(0), c);
+	EXPECT_EQ(b->GetDuplicateCount(), 0);
+
+	// Compiling again starts over
+	EXPECT_EQ(library.CompileDuplicates(), 3);
+	EXPECT_EQ(a->GetDuplicateCount(), 1);
+}
@@ -5,6 +5,11 @@
 #include "../include/decision_thread.h"
 #include "../include/song_generator.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 TEST(DecisionThreadTest, SanityCheck) {
 	toccata::Library library;
 
@@ -23,8 +28,9 @@ TEST(DecisionThreadTest, SanityCheck) {
 
 	std::default_random_engine engine;
 
-	int i = 0;
-	while (!decisionThread.IsComplete()) {
+	// The thread can catch up before the first note is added, so at least
+	// one note is always added before checking
+	do {
 		const int n = inputSegment.NoteContainer.GetCount();
 
 		if (n > 0) {
@@ -34,7 +40,7 @@ TEST(DecisionThreadTest, SanityCheck) {
 			decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
 			inputSegment.NoteContainer.RemovePoint(i);
 		}
-	}
+	} while (!decisionThread.IsComplete());
 
 	decisionThread.KillThreads();
 	decisionThread.Destroy();
@@ -52,3 +58,417 @@ TEST(DecisionThreadTest, SanityCheck) {
 
 	EXPECT_EQ(longest, 3 * 8);
 }
+
+TEST(DecisionThreadTest, HorizonSoak) {
+	constexpr int BarCount = 400;
+	constexpr int BarsPerBlock = 50;
+	constexpr int NotesPerUpdate = 48;
+
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, BarCount, 0, 1.0, 0, 0);
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 1, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.SetHorizon(8, 0.0);
+	decisionThread.StartThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	const int notesPerBlock = n / (BarCount / BarsPerBlock);
+	const toccata::MusicPoint *points = inputSegment.NoteContainer.GetPoints();
+	toccata::DecisionTree *tree = decisionThread.GetTree();
+
+	int peakLiveNotes = 0;
+	int peakDecisions = 0;
+
+	// Decisions visited by index queries stand in for the cost per note,
+	// which would grow with the session if old state weren't retired
+	std::vector<long long> blockVisited(BarCount / BarsPerBlock + 1, 0);
+	long long visited = 0;
+
+	for (int i = 0; i < n; ++i) {
+		decisionThread.AddNote(points[i]);
+
+		if ((i + 1) % NotesPerUpdate == 0) {
+			while (!decisionThread.IsComplete()) {
+				std::this_thread::yield();
+			}
+
+			peakLiveNotes = std::max(peakLiveNotes, tree->GetInputSegment()->NoteContainer.GetCount());
+			peakDecisions = std::max(peakDecisions, tree->GetDecisionCount());
+
+			const long long totalVisited = tree->GetQueryStatistics().VisitedDecisions;
+			blockVisited[i / notesPerBlock] += totalVisited - visited;
+			visited = totalVisited;
+		}
+	}
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+
+	toccata::DecisionThread::Archive archive;
+	decisionThread.ReadArchive(&archive);
+
+	const int liveNotes = tree->GetInputSegment()->NoteContainer.GetCount();
+	EXPECT_EQ(liveNotes + decisionThread.GetIndexOffset(), n);
+	EXPECT_EQ((int)archive.Notes.size(), decisionThread.GetIndexOffset());
+	EXPECT_FALSE(archive.Pieces.empty());
+
+	// Live state never grows past a fraction of the session
+	EXPECT_LT(peakLiveNotes, notesPerBlock);
+	EXPECT_LT(peakDecisions, BarsPerBlock);
+
+	// The last full block costs no more than an early one. The first block
+	// is skipped since the horizon only starts retiring input partway in.
+	const int lastBlock = BarCount / BarsPerBlock - 1;
+	EXPECT_GT(blockVisited[1], 0);
+	EXPECT_LT(blockVisited[lastBlock], 2 * blockVisited[1]);
+}
+
+TEST(DecisionThreadTest, ParksWhenIdle) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 4, 0, 1.0, 0, 0);
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 1, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.StartThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+	}
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	// The thread spins briefly before parking
+	while (!decisionThread.IsParked()) {
+		std::this_thread::yield();
+	}
+
+	const long long iterations = decisionThread.GetIterationCount();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	EXPECT_TRUE(decisionThread.IsParked());
+	EXPECT_EQ(decisionThread.GetIterationCount(), iterations);
+
+	// Work added while parked is still picked up
+	toccata::MusicPoint point = inputSegment.NoteContainer.GetPoints()[n - 1];
+	point.Timestamp += 1;
+	decisionThread.AddNote(point);
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	EXPECT_EQ(decisionThread.GetTree()->GetInputSegment()->NoteContainer.GetCount(), n + 1);
+	EXPECT_GT(decisionThread.ReadPeakWakeLatency(), 0.0);
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+}
+
+TEST(DecisionThreadTest, NotesFromProducerThread) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 1, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.StartThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	const toccata::MusicPoint *points = inputSegment.NoteContainer.GetPoints();
+
+	// Notes arrive from another thread while the decision thread is busy
+	int dropped = 0;
+	std::thread producer([&] {
+		for (int i = 0; i < n; ++i) {
+			if (!decisionThread.AddNote(points[i])) ++dropped;
+			if (i % 8 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+	producer.join();
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+
+	EXPECT_EQ(dropped, 0);
+
+	const toccata::MusicSegment *buffer = decisionThread.GetTree()->GetInputSegment();
+	ASSERT_EQ(buffer->NoteContainer.GetCount(), n);
+	for (int i = 0; i < n; ++i) {
+		EXPECT_EQ(buffer->NoteContainer.GetPoints()[i].Timestamp, points[i].Timestamp);
+	}
+}
+
+TEST(DecisionThreadTest, SnapshotsReadWhileSolving) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 1, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.StartThreads();
+
+	std::atomic<bool> done(false);
+	bool versionsIncreasing = true;
+	int reads = 0;
+
+	std::thread reader([&] {
+		long long lastVersion = 0;
+		while (!done) {
+			const long long version = decisionThread.GetSnapshotVersion();
+			decisionThread.GetPieces();
+			decisionThread.ReadPeakLatency();
+
+			if (version < lastVersion) versionsIncreasing = false;
+			lastVersion = version;
+			++reads;
+		}
+	});
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+	}
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	done = true;
+	reader.join();
+
+	EXPECT_TRUE(versionsIncreasing);
+	EXPECT_GT(reads, 0);
+	EXPECT_GT(decisionThread.GetSnapshotVersion(), 0);
+
+	const std::vector<toccata::DecisionTree::MatchedPiece> pieces = decisionThread.GetPieces();
+	ASSERT_EQ(pieces.size(), 1);
+	EXPECT_EQ(pieces[0].Bars.size(), 16);
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+}
+
+TEST(DecisionThreadTest, IterationBudget) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+
+	songGenerator.GenerateSong(&library, 3, 8);
+	songGenerator.GenerateSong(&library, 3, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 3 * 8, 0, 1.0, 0, 0);
+
+	// Every iteration runs out of time after one bar per worker, so each
+	// start index is spread over many iterations
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 4, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.SetIterationBudget(1E-6);
+	decisionThread.StartThreads();
+
+	std::default_random_engine engine;
+
+	do {
+		const int n = inputSegment.NoteContainer.GetCount();
+
+		if (n > 0) {
+			std::uniform_int_distribution<int> index(0, n - 1);
+
+			const int i = index(engine);
+			decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+			inputSegment.NoteContainer.RemovePoint(i);
+		}
+	} while (!decisionThread.IsComplete());
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+
+	toccata::DecisionTree *tree = decisionThread.GetTree();
+	EXPECT_FALSE(tree->IsPassPending());
+
+	int longest = -1;
+	for (int i = 0; i < tree->GetDecisionCount(); ++i) {
+		const int depth = tree->GetDepth(tree->GetDecision(i));
+		if (depth > longest) {
+			longest = depth;
+		}
+	}
+
+	EXPECT_EQ(longest, 3 * 8);
+}
+
+TEST(DecisionThreadTest, StageLatencies) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 2, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.StartThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+	}
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	// Nothing has been read yet, so the histograms cover the whole run
+	const toccata::LatencyHistogram ingest = decisionThread.ReadStageLatency(toccata::DecisionThread::Stage::Ingest);
+	const toccata::LatencyHistogram match = decisionThread.ReadStageLatency(toccata::DecisionThread::Stage::Match);
+	const toccata::LatencyHistogram integrate = decisionThread.ReadStageLatency(toccata::DecisionThread::Stage::Integrate);
+	const toccata::LatencyHistogram publish = decisionThread.ReadStageLatency(toccata::DecisionThread::Stage::Publish);
+
+	EXPECT_GT(ingest.GetCount(), 0);
+	EXPECT_GT(match.GetCount(), 0);
+	// Cancelled slices are timed but never integrated
+	EXPECT_LE(integrate.GetCount(), match.GetCount());
+	EXPECT_GT(integrate.GetCount(), 0);
+	EXPECT_GT(publish.GetCount(), 0);
+
+	EXPECT_LE(match.GetPercentile(0.5), match.GetPercentile(0.95));
+	EXPECT_LE(match.GetPercentile(0.95), match.GetMax());
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+}
+
+TEST(DecisionThreadTest, ElasticWorkers) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	const int n = inputSegment.NoteContainer.GetCount();
+
+	// A target that can't be met adds workers up to the limit, and one that
+	// is always met never leaves the minimum
+	for (double target : { 1E-9, 1E3 }) {
+		toccata::DecisionThread decisionThread;
+		decisionThread.Initialize(&library, 4, inputSegment.PulseUnit, inputSegment.PulseRate);
+		decisionThread.SetWorkerLimits(1, 8);
+		decisionThread.SetTargetLatency(target);
+		decisionThread.StartThreads();
+
+		EXPECT_EQ(decisionThread.GetMaximumWorkers(), 4);
+
+		for (int i = 0; i < n; ++i) {
+			decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+		}
+
+		while (!decisionThread.IsComplete()) {
+			std::this_thread::yield();
+		}
+
+		EXPECT_EQ(decisionThread.ReadPeakActiveWorkers(), (target < 1.0) ? 4 : 1);
+
+		const std::vector<toccata::DecisionTree::MatchedPiece> pieces = decisionThread.GetPieces();
+		ASSERT_EQ(pieces.size(), 1);
+		EXPECT_EQ(pieces[0].Bars.size(), 16);
+
+		decisionThread.KillThreads();
+		decisionThread.Destroy();
+	}
+}
+
+TEST(DecisionThreadTest, RealtimeMode) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	inputSegment.PulseRate = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::ThreadUtilities::RealtimeSettings settings;
+	settings.Enabled = true;
+	settings.CpuMask = 1;
+	settings.Policy = toccata::ThreadUtilities::SchedulingPolicy::Fifo;
+	settings.LockMemory = true;
+
+	toccata::DecisionThread decisionThread;
+	decisionThread.Initialize(&library, 2, inputSegment.PulseUnit, inputSegment.PulseRate);
+	decisionThread.SetRealtimeSettings(settings);
+	decisionThread.StartThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		decisionThread.AddNote(inputSegment.NoteContainer.GetPoints()[i]);
+	}
+
+	while (!decisionThread.IsComplete()) {
+		std::this_thread::yield();
+	}
+
+	// Without permissions everything falls back to the default settings,
+	// which must not change the result. At most the coordinator, both
+	// workers and both solvers can fail.
+	EXPECT_LE(decisionThread.GetRealtimeFailures(), 5);
+
+	const std::vector<toccata::DecisionTree::MatchedPiece> pieces = decisionThread.GetPieces();
+	ASSERT_EQ(pieces.size(), 1);
+	EXPECT_EQ(pieces[0].Bars.size(), 16);
+
+	decisionThread.KillThreads();
+	decisionThread.Destroy();
+}
@@ -6,6 +6,73 @@
 #include "../include/library.h"
 #include "../include/music_segment.h"
 #include "../include/song_generator.h"
+#include "../include/segment_generator.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace {
+
+	struct FeaturePass {
+		toccata::DecisionTree::SolverStatistics Statistics;
+		std::vector<toccata::DecisionTree::MatchedPiece> Pieces;
+		double InputTatum = 0.0;
+	};
+
+	// Processes the input once with a feature off and once with it on. The
+	// match cache is off for both passes and anything else is set up by the
+	// callback before the tree is initialized.
+	void RunFeaturePasses(
+		toccata::Library *library, toccata::MusicSegment *input,
+		const std::function<void(toccata::DecisionTree *tree, bool enabled)> &configure,
+		FeaturePass passes[2])
+	{
+		for (int pass = 0; pass < 2; ++pass) {
+			toccata::DecisionTree tree;
+			tree.SetLibrary(library);
+			tree.SetInputSegment(input);
+			tree.SetMatchCacheEnabled(false);
+			configure(&tree, pass == 1);
+			tree.Initialize(1);
+			tree.SpawnThreads();
+
+			const int n = input->NoteContainer.GetCount();
+			for (int i = 0; i < n; ++i) {
+				tree.Process(i);
+			}
+
+			passes[pass].Statistics = tree.GetSolverStatistics();
+			passes[pass].Pieces = tree.GetPieces();
+			passes[pass].InputTatum = tree.GetInputTatum();
+
+			tree.KillThreads();
+			tree.Destroy();
+		}
+	}
+
+	// Expects both passes to find the same first piece. Bars from the same
+	// group of identical bars are interchangeable if canonical is set.
+	void ExpectSamePieces(const FeaturePass &off, const FeaturePass &on, size_t barCount, bool canonical = false) {
+		ASSERT_EQ(on.Pieces.size(), off.Pieces.size());
+		ASSERT_FALSE(off.Pieces.empty());
+		ASSERT_EQ(on.Pieces[0].Bars.size(), off.Pieces[0].Bars.size());
+		EXPECT_EQ(on.Pieces[0].Bars.size(), barCount);
+
+		for (size_t i = 0; i < off.Pieces[0].Bars.size(); ++i) {
+			const toccata::Bar *expected = off.Pieces[0].Bars[i].MatchedBar;
+			const toccata::Bar *actual = on.Pieces[0].Bars[i].MatchedBar;
+			if (canonical) {
+				expected = expected->GetCanonical();
+				actual = actual->GetCanonical();
+			}
+
+			EXPECT_EQ(actual, expected);
+			EXPECT_EQ(on.Pieces[0].Bars[i].Start, off.Pieces[0].Bars[i].Start);
+		}
+	}
+
+} /* namespace */
 
 TEST(DecisionTreeTest, SanityCheck) {
 	toccata::DecisionTree tree;
@@ -417,3 +484,842 @@ TEST(DecisionTreeTest, SimilarSongs_2) {
 	tree.KillThreads();
 	tree.Destroy();
 }
+
+TEST(DecisionTreeTest, LongSessionScaling) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 1, 8);
+
+	// 1125 bars at 1.6 seconds per bar is a 30 minute session
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 1125, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	const int sampleLength = n / 10;
+
+	// Decisions visited by index queries stand in for the integrate cost,
+	// a scan over every decision would grow with the session
+	long long firstSample = 0;
+	long long lastSample = 0;
+	for (int i = 0; i < n; ++i) {
+		const long long before = tree.GetQueryStatistics().VisitedDecisions;
+		tree.Process(i);
+		const long long visited = tree.GetQueryStatistics().VisitedDecisions - before;
+
+		if (i < sampleLength) firstSample += visited;
+		else if (i >= n - sampleLength) lastSample += visited;
+	}
+
+	EXPECT_GE(tree.GetDecisionCount(), 1125);
+	EXPECT_GT(firstSample, 0);
+	EXPECT_LT(lastSample, 2 * firstSample);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, PieceListRebuiltOnlyAfterChange) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 32);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	EXPECT_TRUE(tree.IsPieceListDirty());
+
+	auto results = tree.GetPieces();
+	EXPECT_FALSE(tree.IsPieceListDirty());
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 16);
+
+	auto cachedResults = tree.GetPieces();
+	ASSERT_EQ(cachedResults.size(), 1);
+	EXPECT_EQ(cachedResults[0].Bars.size(), 16);
+
+	const int changed = n / 2;
+	const int decisionCount = tree.GetDecisionCount();
+
+	int dependents = 0;
+	for (int i = 0; i < decisionCount; ++i) {
+		const toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+		if (d->WindowStart <= changed && d->WindowEnd >= changed) ++dependents;
+	}
+
+	ASSERT_GT(dependents, 0);
+
+	tree.OnNoteChange(changed);
+	EXPECT_TRUE(tree.IsPieceListDirty());
+
+	// Only the decisions that depended on the changed note are removed
+	EXPECT_EQ(tree.GetDecisionCount(), decisionCount - dependents);
+	for (int i = 0; i < tree.GetDecisionCount(); ++i) {
+		const toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+		EXPECT_FALSE(d->WindowStart <= changed && d->WindowEnd >= changed);
+	}
+
+	results = tree.GetPieces();
+	EXPECT_FALSE(tree.IsPieceListDirty());
+	EXPECT_FALSE(results.empty());
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, BranchScoresConsistent) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 32);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 32, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+
+		if (i == n / 2) {
+			tree.OnNoteChange(n / 4);
+		}
+	}
+
+	const int decisionCount = tree.GetDecisionCount();
+	for (int i = 0; i < decisionCount; ++i) {
+		toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+		const int depth = tree.GetDepth(d);
+		const int noteCount = tree.GetBranchNoteCount(d);
+
+		toccata::DecisionTree::Decision *parent = tree.GetParent(d);
+		if (parent != nullptr) {
+			EXPECT_LT(parent->GetEnd(), d->GetEnd());
+			EXPECT_EQ(depth, tree.GetDepth(parent) + 1);
+			EXPECT_EQ(noteCount, tree.GetBranchNoteCount(parent) + d->MappedNotes);
+		}
+		else {
+			EXPECT_EQ(depth, 1);
+			EXPECT_EQ(noteCount, d->MappedNotes);
+		}
+	}
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, MatchCacheSkipsUnchangedWindows) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 8, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics first = tree.GetMatchCacheStatistics();
+	const int decisionCount = tree.GetDecisionCount();
+	EXPECT_EQ(first.Hits + first.Misses, (long long)n * library.GetBarCount());
+
+	// Reprocessing unchanged input never calls the solver
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics second = tree.GetMatchCacheStatistics();
+	EXPECT_EQ(second.Misses, first.Misses);
+	EXPECT_EQ(second.Hits, first.Hits + (long long)n * library.GetBarCount());
+	EXPECT_GT(second.SavedTime, 0.0);
+	EXPECT_EQ(tree.GetDecisionCount(), decisionCount);
+
+	// Only windows that contain a changed note are solved again
+	toccata::MusicPoint *points = inputSegment.NoteContainer.GetPoints();
+	points[n - 1].Timestamp += 1;
+	tree.OnNoteChange(n - 1);
+
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics third = tree.GetMatchCacheStatistics();
+	EXPECT_GT(third.Misses, second.Misses);
+	EXPECT_LT(third.Misses - second.Misses, (long long)n * library.GetBarCount() / 2);
+
+	auto results = tree.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 8);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, LateNoteOnlyInvalidatesDependents) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 8, 0, 1.0, 0, 0);
+
+	// Hold back one note from the middle of the input
+	const int late = inputSegment.NoteContainer.GetCount() / 2;
+	const toccata::MusicPoint latePoint = inputSegment.NoteContainer.GetPoints()[late];
+	inputSegment.NoteContainer.RemovePoint(late);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	// The note goes in front of any note with the same onset
+	int index = 0;
+	while (index < n && inputSegment.NoteContainer.GetPoints()[index].Timestamp < latePoint.Timestamp) ++index;
+
+	const int decisionCount = tree.GetDecisionCount();
+
+	int dependents = 0;
+	for (int i = 0; i < decisionCount; ++i) {
+		const toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+		if (d->WindowStart < index && d->WindowEnd >= index) ++dependents;
+	}
+
+	ASSERT_EQ(inputSegment.NoteContainer.AddPoint(latePoint), index);
+	tree.OnNoteInserted(index);
+
+	EXPECT_EQ(tree.GetDecisionCount(), decisionCount - dependents);
+
+	// Decisions after the late note move along with the input
+	for (int i = 0; i < tree.GetDecisionCount(); ++i) {
+		const toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+		EXPECT_TRUE(d->WindowEnd < index || d->WindowStart > index);
+
+		for (int note : d->Notes) {
+			EXPECT_NE(note, index);
+		}
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics before = tree.GetMatchCacheStatistics();
+
+	const int firstDependent = tree.GetFirstDependentStart(index);
+	for (int i = firstDependent; i <= index; ++i) {
+		tree.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics after = tree.GetMatchCacheStatistics();
+	EXPECT_EQ(after.Hits + after.Misses - before.Hits - before.Misses,
+		(long long)(index - firstDependent + 1) * library.GetBarCount());
+
+	auto results = tree.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 8);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, ReverificationAvoidsSolves) {
+	const std::string paths[] =
+	{
+		"../../../test/midi/simple_passage.midi",
+		"../../../test/midi/simple_passage_2.mid"
+	};
+
+	toccata::Library library;
+	for (const std::string &path : paths) {
+		toccata::MidiStream stream;
+		toccata::MidiFile midiFile;
+		midiFile.Read(path.c_str(), &stream);
+
+		toccata::SegmentGenerator::Convert(&stream, &library, "", 0);
+	}
+
+	toccata::MusicSegment inputSegment;
+	inputSegment.PulseUnit = 1.0;
+	GenerateInput(library.GetBar(0), &inputSegment, 3, 0, 1.0, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetTempoTrackingEnabled(false);
+		tree->SetReverificationEnabled(enabled);
+	}, passes);
+
+	EXPECT_EQ(passes[0].Statistics.Reverified, 0);
+	EXPECT_GT(passes[1].Statistics.Reverified, 0);
+	EXPECT_EQ(
+		passes[1].Statistics.FullSolves + passes[1].Statistics.Reverified,
+		passes[0].Statistics.FullSolves);
+
+	EXPECT_EQ(passes[0].Pieces.size(), 1);
+	ExpectSamePieces(passes[0], passes[1], 3);
+	EXPECT_EQ(passes[1].Pieces[0].Bars[0].MatchedBar->GetId(), 0);
+}
+
+TEST(DecisionTreeTest, ReverificationRefreshesLongStreaks) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 5, 1.2, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetTempoTrackingEnabled(false);
+		tree->SetReverificationEnabled(enabled);
+	}, passes);
+
+	// Other bars failing to re-verify don't hold back the refresh of the
+	// bars that keep re-verifying
+	EXPECT_EQ(passes[0].Statistics.ReverificationRefreshes, 0);
+	EXPECT_GT(passes[1].Statistics.Reverified, 16);
+	EXPECT_GT(passes[1].Statistics.ReverificationRefreshes, 0);
+
+	EXPECT_EQ(passes[0].Pieces.size(), 1);
+	ExpectSamePieces(passes[0], passes[1], 16);
+}
+
+TEST(DecisionTreeTest, ParallelIntegration) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	for (int threadCount : { 1, 4 }) {
+		toccata::DecisionTree tree;
+		tree.SetLibrary(&library);
+		tree.SetInputSegment(&inputSegment);
+		tree.Initialize(threadCount);
+		tree.SpawnThreads();
+
+		const int n = inputSegment.NoteContainer.GetCount();
+		for (int i = 0; i < n; ++i) {
+			tree.Process(i);
+		}
+
+		auto results = tree.GetPieces();
+		ASSERT_EQ(results.size(), 1);
+		EXPECT_EQ(results[0].Bars.size(), 16);
+
+		// No two decisions for the same bar share notes
+		for (int i = 0; i < tree.GetDecisionCount(); ++i) {
+			for (int j = i + 1; j < tree.GetDecisionCount(); ++j) {
+				const toccata::DecisionTree::Decision *a = tree.GetDecision(i);
+				const toccata::DecisionTree::Decision *b = tree.GetDecision(j);
+				if (a->MatchedBar != b->MatchedBar) continue;
+
+				const int minNoteCount = std::min(a->MappedNotes, b->MappedNotes);
+				EXPECT_FALSE(a->Overlapping(b, (int)std::ceil(0.5 * minNoteCount)));
+			}
+		}
+
+		tree.KillThreads();
+		tree.Destroy();
+	}
+}
+
+TEST(DecisionTreeTest, CancelledPassDiscardsCandidates) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(4);
+	tree.SpawnThreads();
+
+	toccata::CancellationToken token;
+	token.Cancel();
+
+	EXPECT_FALSE(tree.Process(0, &token));
+	EXPECT_EQ(tree.GetDecisionCount(), 0);
+	EXPECT_EQ(tree.GetSolverStatistics().CancelledPasses, 1);
+	EXPECT_EQ(tree.GetSolverStatistics().FullSolves, 0);
+
+	// Restarting from the same index gives the same result as if the pass
+	// had never been cancelled
+	token.Reset();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		EXPECT_TRUE(tree.Process(i, &token));
+	}
+
+	auto results = tree.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 16);
+	EXPECT_EQ(tree.GetSolverStatistics().CancelledPasses, 1);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, AnytimePassMatchesLikelyBarsFirst) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	// Same route through the song as the input
+	const toccata::Bar *target = library.GetBar(0);
+	for (int i = 0; i < 8; ++i) {
+		target = target->GetNext(target->GetNextCount() > 1 ? 1 : 0);
+	}
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	auto findTarget = [&tree, target](int startIndex) {
+		for (int i = 0; i < tree.GetDecisionCount(); ++i) {
+			const toccata::DecisionTree::Decision *d = tree.GetDecision(i);
+			if (d->MatchedBar == target && d->WindowStart == startIndex) return true;
+		}
+
+		return false;
+	};
+
+	// A deadline that has already passed still matches one bar per slice.
+	// The first slice at the index where the target bar is first found
+	// should be the one that finds it.
+	const int n = inputSegment.NoteContainer.GetCount();
+	int slices = 0;
+	int firstFound = -1;
+	bool foundInFirstSlice = false;
+	for (int i = 0; i < n; ++i) {
+		tree.BeginPass(i);
+
+		toccata::DecisionTree::PassStatus status;
+		int passSlices = 0;
+		do {
+			status = tree.ContinuePass(std::chrono::steady_clock::now());
+			++passSlices;
+
+			if (firstFound == -1 && findTarget(i)) {
+				firstFound = i;
+				foundInFirstSlice = (passSlices == 1);
+			}
+		} while (status == toccata::DecisionTree::PassStatus::Partial);
+
+		EXPECT_EQ(status, toccata::DecisionTree::PassStatus::Complete);
+		EXPECT_FALSE(tree.IsPassPending());
+
+		slices += passSlices;
+	}
+
+	EXPECT_GE(firstFound, 0);
+	EXPECT_TRUE(foundInFirstSlice);
+	EXPECT_EQ(slices, n * library.GetBarCount());
+
+	// Passes spread over many slices give the same result as whole passes
+	auto results = tree.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 16);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, PipelinedPassesMatchSerialPasses) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	const int n = inputSegment.NoteContainer.GetCount();
+
+	toccata::DecisionTree serial;
+	serial.SetLibrary(&library);
+	serial.SetInputSegment(&inputSegment);
+	serial.Initialize(1);
+	serial.SpawnThreads();
+
+	for (int i = 0; i < n; ++i) {
+		serial.Process(i);
+	}
+
+	toccata::DecisionTree pipelined;
+	pipelined.SetLibrary(&library);
+	pipelined.SetInputSegment(&inputSegment);
+	pipelined.Initialize(4);
+	pipelined.SpawnThreads();
+
+	constexpr int Depth = 4;
+	for (int i = 0; i < n; i += Depth) {
+		int indices[Depth];
+		const int count = std::min(Depth, n - i);
+		for (int j = 0; j < count; ++j) {
+			indices[j] = i + j;
+		}
+
+		pipelined.BeginPass(indices, count);
+		EXPECT_EQ(
+			pipelined.ContinuePass(std::chrono::steady_clock::time_point::max()),
+			toccata::DecisionTree::PassStatus::Complete);
+	}
+
+	EXPECT_EQ(pipelined.GetDecisionCount(), serial.GetDecisionCount());
+
+	auto serialResults = serial.GetPieces();
+	auto results = pipelined.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	ASSERT_EQ(serialResults.size(), 1);
+	ASSERT_EQ(results[0].Bars.size(), serialResults[0].Bars.size());
+
+	for (size_t i = 0; i < results[0].Bars.size(); ++i) {
+		EXPECT_EQ(results[0].Bars[i].MatchedBar, serialResults[0].Bars[i].MatchedBar);
+		EXPECT_EQ(results[0].Bars[i].Start, serialResults[0].Bars[i].Start);
+		EXPECT_EQ(results[0].Bars[i].End, serialResults[0].Bars[i].End);
+	}
+
+	serial.KillThreads();
+	serial.Destroy();
+
+	pipelined.KillThreads();
+	pipelined.Destroy();
+}
+
+TEST(DecisionTreeTest, ActiveThreadCountChangesBetweenPasses) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 16);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(4);
+	tree.SpawnThreads();
+
+	EXPECT_EQ(tree.GetActiveThreadCount(), 4);
+
+	tree.SetActiveThreadCount(0);
+	tree.Process(0);
+	EXPECT_EQ(tree.GetActiveThreadCount(), 1);
+
+	tree.SetActiveThreadCount(8);
+	tree.Process(1);
+	EXPECT_EQ(tree.GetActiveThreadCount(), 4);
+
+	// Every bar is still matched exactly once per pass whatever the
+	// number of active workers
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 2; i < n; ++i) {
+		const toccata::DecisionTree::MatchCacheStatistics before = tree.GetMatchCacheStatistics();
+
+		tree.SetActiveThreadCount(1 + i % 4);
+		tree.Process(i);
+
+		const toccata::DecisionTree::MatchCacheStatistics after = tree.GetMatchCacheStatistics();
+		EXPECT_EQ(after.Hits + after.Misses - before.Hits - before.Misses, library.GetBarCount());
+	}
+
+	auto results = tree.GetPieces();
+	ASSERT_EQ(results.size(), 1);
+	EXPECT_EQ(results[0].Bars.size(), 16);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, ScoreFollowingMatchesFullSearch) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 16, 8);
+
+	const int secondSong = library.GetBarCount();
+	songGenerator.GenerateSong(&library, 16, 8);
+
+	// The player switches songs halfway through, which the follower has
+	// to notice
+	toccata::MusicSegment inputSegment, secondSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 12, 0, 1.0, 0, 0);
+	GenerateInput(library.GetBar(secondSong), &secondSegment, 12, 0, 1.0, 0, 0);
+	toccata::SegmentGenerator::Append(&inputSegment, &secondSegment);
+
+	const int n = inputSegment.NoteContainer.GetCount();
+
+	toccata::DecisionTree full;
+	full.SetLibrary(&library);
+	full.SetInputSegment(&inputSegment);
+	full.Initialize(1);
+	full.SpawnThreads();
+
+	toccata::DecisionTree follower;
+	follower.SetLibrary(&library);
+	follower.SetInputSegment(&inputSegment);
+	follower.SetFollowerEnabled(true);
+	follower.SetFollowerParameters(4, 2, 16);
+	follower.Initialize(1);
+	follower.SpawnThreads();
+
+	for (int i = 0; i < n; ++i) {
+		full.Process(i);
+		follower.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics fullMatches = full.GetMatchCacheStatistics();
+	const toccata::DecisionTree::MatchCacheStatistics followerMatches = follower.GetMatchCacheStatistics();
+
+	EXPECT_GT(follower.GetSolverStatistics().FollowedPasses, n / 2);
+	EXPECT_LT(
+		followerMatches.Hits + followerMatches.Misses,
+		(fullMatches.Hits + fullMatches.Misses) / 4);
+
+	auto fullResults = full.GetPieces();
+	auto results = follower.GetPieces();
+	ASSERT_EQ(results.size(), fullResults.size());
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		ASSERT_EQ(results[i].Bars.size(), fullResults[i].Bars.size());
+
+		for (size_t j = 0; j < results[i].Bars.size(); ++j) {
+			EXPECT_EQ(results[i].Bars[j].MatchedBar, fullResults[i].Bars[j].MatchedBar);
+			EXPECT_EQ(results[i].Bars[j].Start, fullResults[i].Bars[j].Start);
+		}
+	}
+
+	full.KillThreads();
+	full.Destroy();
+
+	follower.KillThreads();
+	follower.Destroy();
+}
+
+TEST(DecisionTreeTest, TempoTrackingNarrowsSearch) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 24, 5, 1.2, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetReverificationEnabled(false);
+		tree->SetTempoTrackingEnabled(enabled);
+	}, passes);
+
+	EXPECT_EQ(passes[0].Statistics.PredictionAttempts, 0);
+	EXPECT_GT(passes[1].Statistics.Predicted, 0);
+	EXPECT_LT(passes[1].Statistics.EvaluatedHypotheses, passes[0].Statistics.EvaluatedHypotheses);
+
+	EXPECT_EQ(passes[0].Pieces.size(), 1);
+	ExpectSamePieces(passes[0], passes[1], 24);
+}
+
+TEST(DecisionTreeTest, TempoPriorNarrowsSearch) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 24, 5, 1.2, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetReverificationEnabled(false);
+		tree->SetTempoTrackingEnabled(false);
+		tree->SetTempoPriorEnabled(enabled);
+	}, passes);
+
+	EXPECT_GT(passes[1].InputTatum, 0.0);
+	EXPECT_LT(passes[1].Statistics.EvaluatedHypotheses, passes[0].Statistics.EvaluatedHypotheses);
+
+	EXPECT_EQ(passes[0].Pieces.size(), 1);
+	ExpectSamePieces(passes[0], passes[1], 24);
+}
+
+TEST(DecisionTreeTest, MatchCacheKeysOnTempoPrior) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 8, 5, 1.2, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&library);
+	tree.SetInputSegment(&inputSegment);
+	tree.SetReverificationEnabled(false);
+	tree.SetTempoTrackingEnabled(false);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	ASSERT_GT(tree.GetInputTatum(), 0.0);
+	const toccata::DecisionTree::MatchCacheStatistics first = tree.GetMatchCacheStatistics();
+
+	// Results pruned by the prior can't be reused without it
+	tree.SetTempoPriorEnabled(false);
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics second = tree.GetMatchCacheStatistics();
+	EXPECT_GT(second.Misses, first.Misses);
+
+	// ... but are reused while the prior stays the same
+	tree.SetTempoPriorEnabled(true);
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int i = 0; i < n; ++i) {
+			tree.Process(i);
+		}
+	}
+
+	const toccata::DecisionTree::MatchCacheStatistics third = tree.GetMatchCacheStatistics();
+	EXPECT_EQ(third.Misses - second.Misses, second.Misses - first.Misses);
+
+	tree.KillThreads();
+	tree.Destroy();
+}
+
+TEST(DecisionTreeTest, DuplicateBarsShareMatches) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	// A second copy of the song with the same links
+	const int barCount = library.GetBarCount();
+	for (int i = 0; i < barCount; ++i) {
+		toccata::MusicSegment *segment = library.NewSegment();
+		toccata::SegmentGenerator::Copy(library.GetBar(i)->GetSegment(), segment);
+
+		library.NewBar()->SetSegment(segment);
+	}
+
+	for (int i = 0; i < barCount; ++i) {
+		const toccata::Bar *bar = library.GetBar(i);
+		for (int j = 0; j < bar->GetNextCount(); ++j) {
+			library.GetBar(barCount + i)->AddNext(library.GetBar(barCount + bar->GetNext(j)->GetId()));
+		}
+	}
+
+	EXPECT_EQ(library.CompileDuplicates(), barCount);
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 16, 5, 1.2, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetDeduplicationEnabled(enabled);
+	}, passes);
+
+	EXPECT_EQ(passes[0].Statistics.SharedMatches, 0);
+	EXPECT_GT(passes[1].Statistics.SharedMatches, 0);
+	EXPECT_LT(passes[1].Statistics.EvaluatedHypotheses, passes[0].Statistics.EvaluatedHypotheses);
+
+	// Either copy of the song is as good a match as the other
+	ExpectSamePieces(passes[0], passes[1], 16, true);
+}
+
+TEST(DecisionTreeTest, PrefilterSkipsUnmatchableBars) {
+	toccata::Library library;
+
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+	library.CompileSummaries();
+
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 24, 5, 1.2, 0, 0);
+
+	FeaturePass passes[2];
+	RunFeaturePasses(&library, &inputSegment, [](toccata::DecisionTree *tree, bool enabled) {
+		tree->SetPrefilterEnabled(enabled);
+	}, passes);
+
+	EXPECT_EQ(passes[0].Statistics.Prefiltered, 0);
+	EXPECT_GT(passes[1].Statistics.Prefiltered, 0);
+	EXPECT_LT(passes[1].Statistics.EvaluatedHypotheses, passes[0].Statistics.EvaluatedHypotheses);
+
+	// Only bars that couldn't have matched are skipped
+	EXPECT_EQ(passes[0].Pieces.size(), 1);
+	ExpectSamePieces(passes[0], passes[1], 24);
+}
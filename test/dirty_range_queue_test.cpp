@@ -0,0 +1,52 @@
+#include <pch.h>
+
+#include "../include/dirty_range_queue.h"
+
+#include <vector>
+
+namespace {
+
+	std::vector<int> Drain(toccata::DirtyRangeQueue *queue) {
+		std::vector<int> indices;
+		while (!queue->IsEmpty()) {
+			indices.push_back(queue->Pop());
+		}
+
+		return indices;
+	}
+
+} /* namespace */
+
+TEST(DirtyRangeQueueTest, MergesRanges) {
+	toccata::DirtyRangeQueue queue;
+	queue.Add(10, 12);
+	queue.Add(2, 4);
+	queue.Add(5, 6);
+	queue.Add(11, 14);
+
+	EXPECT_EQ(queue.GetSize(), 10);
+	EXPECT_EQ(queue.GetFirst(), 2);
+
+	const std::vector<int> expected = { 2, 3, 4, 5, 6, 10, 11, 12, 13, 14 };
+	EXPECT_EQ(Drain(&queue), expected);
+	EXPECT_EQ(queue.GetSize(), 0);
+}
+
+TEST(DirtyRangeQueueTest, InsertAndRemove) {
+	toccata::DirtyRangeQueue queue;
+	queue.Add(2, 5);
+	queue.Add(8, 9);
+
+	// Indices at or after the insertion point move up by one
+	queue.Insert(4);
+	queue.Add(4, 4);
+	EXPECT_EQ(queue.GetSize(), 7);
+
+	toccata::DirtyRangeQueue copy = queue;
+	const std::vector<int> expected = { 2, 3, 4, 5, 6, 9, 10 };
+	EXPECT_EQ(Drain(&copy), expected);
+
+	queue.Remove(5);
+	const std::vector<int> remaining = { 0, 1, 4, 5 };
+	EXPECT_EQ(Drain(&queue), remaining);
+}
@@ -0,0 +1,41 @@
+#include <pch.h>
+
+#include "../include/latency_histogram.h"
+
+TEST(LatencyHistogramTest, Buckets) {
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(0.0), 0);
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(1E-6), 0);
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(1.5E-6), 1);
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(2E-6), 1);
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(1E-3), 10);
+	EXPECT_EQ(toccata::LatencyHistogram::GetBucketIndex(1E6), toccata::LatencyHistogram::BucketCount - 1);
+
+	EXPECT_DOUBLE_EQ(toccata::LatencyHistogram::GetBucketBound(10), 1024E-6);
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+	toccata::LatencyHistogram histogram;
+	EXPECT_EQ(histogram.GetPercentile(0.5), 0.0);
+
+	for (int i = 0; i < 90; ++i) histogram.Record(10E-6);
+	for (int i = 0; i < 10; ++i) histogram.Record(1E-3);
+
+	EXPECT_EQ(histogram.GetCount(), 100);
+	EXPECT_DOUBLE_EQ(histogram.GetMax(), 1E-3);
+
+	// Reported as the upper bound of the bucket
+	EXPECT_DOUBLE_EQ(histogram.GetPercentile(0.5), 16E-6);
+	EXPECT_DOUBLE_EQ(histogram.GetPercentile(0.9), 16E-6);
+	EXPECT_DOUBLE_EQ(histogram.GetPercentile(0.95), 1E-3);
+
+	toccata::LatencyHistogram other;
+	other.Record(2.0);
+	histogram.Add(other);
+
+	EXPECT_EQ(histogram.GetCount(), 101);
+	EXPECT_DOUBLE_EQ(histogram.GetPercentile(1.0), 2.0);
+
+	histogram.Clear();
+	EXPECT_EQ(histogram.GetCount(), 0);
+	EXPECT_EQ(histogram.GetMax(), 0.0);
+}
@@ -0,0 +1,193 @@
+#include <pch.h>
+
+#include "../include/library_file.h"
+#include "../include/song_generator.h"
+#include "../include/decision_tree.h"
+
+#include "utilities.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+TEST(LibraryFileTest, RoundTrip) {
+	const char *path = "library_file_test.tlib";
+
+	toccata::Library library;
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	// Generated songs have no piece of their own
+	toccata::Piece *piece = library.NewPiece();
+	piece->SetName("Generated");
+	library.GetBar(0)->SetPiece(piece);
+	library.CompileDuplicates();
+
+	ASSERT_TRUE(toccata::LibraryFile::Write(&library, path));
+
+	toccata::LibraryFile file;
+	ASSERT_TRUE(file.Open(path));
+
+	toccata::Library loaded;
+	ASSERT_TRUE(file.Load(&loaded));
+
+	ASSERT_EQ(loaded.GetPieceCount(), library.GetPieceCount());
+	ASSERT_EQ(loaded.GetSegmentCount(), library.GetSegmentCount());
+	ASSERT_EQ(loaded.GetBarCount(), library.GetBarCount());
+	EXPECT_EQ(loaded.GetPiece(0)->GetName(), "Generated");
+
+	for (int i = 0; i < library.GetBarCount(); ++i) {
+		const toccata::Bar *bar = library.GetBar(i);
+		const toccata::Bar *loadedBar = loaded.GetBar(i);
+
+		EXPECT_EQ(loadedBar->GetId(), bar->GetId());
+		EXPECT_EQ(loadedBar->GetIndex(), bar->GetIndex());
+		EXPECT_EQ(loadedBar->GetPiece() != nullptr, bar->GetPiece() != nullptr);
+		EXPECT_EQ(loadedBar->GetCanonical()->GetId(), bar->GetCanonical()->GetId());
+
+		ASSERT_EQ(loadedBar->GetNextCount(), bar->GetNextCount());
+		for (int j = 0; j < bar->GetNextCount(); ++j) {
+			EXPECT_EQ(loadedBar->GetNext(j)->GetId(), bar->GetNext(j)->GetId());
+
+			const toccata::Bar::SearchResult expected = bar->FindNext(bar->GetNext(j), 1);
+			const toccata::Bar::SearchResult result = loadedBar->FindNext(loadedBar->GetNext(j), 1);
+			EXPECT_EQ(result.Offset, expected.Offset);
+		}
+
+		const toccata::MusicSegment *segment = bar->GetSegment();
+		const toccata::MusicSegment *loadedSegment = loadedBar->GetSegment();
+		EXPECT_TRUE(loadedSegment->NoteContainer.IsView());
+		EXPECT_EQ(loadedSegment->Length, segment->Length);
+		EXPECT_EQ(loadedSegment->PulseUnit, segment->PulseUnit);
+
+		ASSERT_EQ(loadedSegment->NoteContainer.GetCount(), segment->NoteContainer.GetCount());
+		for (int j = 0; j < segment->NoteContainer.GetCount(); ++j) {
+			EXPECT_EQ(loadedSegment->NoteContainer.GetPoints()[j].Timestamp, segment->NoteContainer.GetPoints()[j].Timestamp);
+			EXPECT_EQ(loadedSegment->NoteContainer.GetPoints()[j].Pitch, segment->NoteContainer.GetPoints()[j].Pitch);
+		}
+	}
+
+	// Changing a loaded segment copies its notes out of the mapping
+	toccata::MusicPointContainer &notes = loaded.GetSegment(0)->NoteContainer;
+	const int n = notes.GetCount();
+	notes.AddPoint({ 0, 10 });
+	EXPECT_FALSE(notes.IsView());
+	EXPECT_EQ(notes.GetCount(), n + 1);
+
+	file.Close();
+	std::remove(path);
+}
+
+TEST(LibraryFileTest, RejectsInvalidFiles) {
+	const char *path = "library_file_test_invalid.tlib";
+
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::out | std::ios::trunc);
+		file << "not a library";
+	}
+
+	toccata::LibraryFile file;
+	EXPECT_FALSE(file.Open(path));
+	EXPECT_FALSE(file.IsOpen());
+	EXPECT_FALSE(file.Open("missing.tlib"));
+
+	std::remove(path);
+}
+
+TEST(LibraryFileTest, RejectsOutOfRangePitches) {
+	const char *path = "library_file_test_pitch.tlib";
+
+	toccata::Library library;
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::Piece *piece = library.NewPiece();
+	library.GetBar(0)->SetPiece(piece);
+	library.CompileDuplicates();
+
+	library.GetSegment(0)->NoteContainer.GetPoints()[0].Pitch = toccata::Library::MaxPitches;
+	EXPECT_FALSE(toccata::LibraryFile::Write(&library, path));
+
+	std::remove(path);
+}
+
+TEST(LibraryFileTest, ChecksMappedNotesWhenUsed) {
+	const char *path = "library_file_test_damaged.tlib";
+
+	toccata::Library library;
+	toccata::SongGenerator songGenerator;
+	songGenerator.Seed(0);
+	songGenerator.GenerateSong(&library, 4, 8);
+
+	toccata::Piece *piece = library.NewPiece();
+	library.GetBar(0)->SetPiece(piece);
+	library.CompileDuplicates();
+	ASSERT_TRUE(toccata::LibraryFile::Write(&library, path));
+
+	// Damage the first note of the last segment in the file itself
+	const int damaged = library.GetSegmentCount() - 1;
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+
+		toccata::MusicPointContainer &notes = library.GetSegment(damaged)->NoteContainer;
+		const char *begin = (const char *)notes.GetPoints();
+		const char *end = begin + sizeof(toccata::MusicPoint) * notes.GetCount();
+
+		auto found = std::find_end(data.begin(), data.end(), begin, end);
+		ASSERT_NE(found, data.end());
+
+		toccata::MusicPoint point = notes.GetPoints()[0];
+		point.Pitch = toccata::Library::MaxPitches;
+		memcpy(&*found, &point, sizeof(point));
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(data.data(), data.size());
+	}
+
+	// Notes aren't read when the file is opened
+	toccata::LibraryFile file;
+	ASSERT_TRUE(file.Open(path));
+
+	toccata::Library loaded;
+	ASSERT_TRUE(file.Load(&loaded));
+
+	for (int i = 0; i < loaded.GetSegmentCount(); ++i) {
+		EXPECT_EQ(loaded.GetSegment(i)->NoteContainer.CheckPitches(toccata::Library::MaxPitches), i != damaged);
+	}
+
+	// The damaged bar is never matched, even without a residency manager
+	toccata::MusicSegment inputSegment;
+	GenerateInput(library.GetBar(0), &inputSegment, 32, 0, 1.0, 0, 0);
+
+	toccata::DecisionTree tree;
+	tree.SetLibrary(&loaded);
+	tree.SetInputSegment(&inputSegment);
+	tree.Initialize(1);
+	tree.SpawnThreads();
+
+	const int n = inputSegment.NoteContainer.GetCount();
+	for (int i = 0; i < n; ++i) {
+		tree.Process(i);
+	}
+
+	const std::vector<toccata::DecisionTree::MatchedPiece> pieces = tree.GetPieces();
+	EXPECT_FALSE(pieces.empty());
+	for (const toccata::DecisionTree::MatchedPiece &matched : pieces) {
+		for (const toccata::DecisionTree::MatchedBar &bar : matched.Bars) {
+			EXPECT_NE(bar.MatchedBar->GetSegment(), loaded.GetSegment(damaged));
+		}
+	}
+
+	tree.KillThreads();
+	tree.Destroy();
+
+	file.Close();
+	std::remove(path);
+}
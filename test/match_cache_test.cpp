@@ -0,0 +1,86 @@
+#include <pch.h>
+
+#include "../include/match_cache.h"
+#include "../include/music_segment.h"
+
+TEST(MatchCacheTest, FindsStoredResults) {
+	toccata::MatchCache cache;
+	cache.SetBarCount(2);
+
+	toccata::MatchCache::Entry entry;
+	entry.Found = true;
+	entry.MappedNotes = 3;
+	entry.Notes = { 0, 1, 2 };
+	cache.Store(1, 10, 42, entry);
+
+	toccata::MatchCache::Entry result;
+	ASSERT_TRUE(cache.Find(1, 10, 42, &result));
+	EXPECT_TRUE(result.Found);
+	EXPECT_EQ(result.MappedNotes, 3);
+	EXPECT_EQ(result.Notes.size(), 3);
+
+	// Different content, position or bar
+	EXPECT_FALSE(cache.Find(1, 10, 43, &result));
+	EXPECT_FALSE(cache.Find(1, 11, 42, &result));
+	EXPECT_FALSE(cache.Find(0, 10, 42, &result));
+	EXPECT_EQ(cache.GetTableCount(), 1);
+}
+
+TEST(MatchCacheTest, TrimsLeastRecentlyUsedTables) {
+	toccata::MatchCache cache;
+	cache.SetBarCount(8);
+	cache.SetTableLimit(4);
+
+	toccata::MatchCache::Entry entry;
+	entry.Found = false;
+	for (int bar = 0; bar < 8; ++bar) {
+		cache.BeginPass();
+		cache.Store(bar, 0, 1, entry);
+	}
+
+	// Reading a table counts as using it
+	toccata::MatchCache::Entry result;
+	cache.BeginPass();
+	EXPECT_TRUE(cache.Find(0, 0, 1, &result));
+
+	EXPECT_EQ(cache.GetTableCount(), 8);
+	cache.Trim();
+	EXPECT_EQ(cache.GetTableCount(), 3);
+
+	EXPECT_TRUE(cache.Find(0, 0, 1, &result));
+	EXPECT_TRUE(cache.Find(6, 0, 1, &result));
+	EXPECT_TRUE(cache.Find(7, 0, 1, &result));
+	EXPECT_FALSE(cache.Find(5, 0, 1, &result));
+
+	// Under the limit nothing is freed
+	cache.Trim();
+	EXPECT_EQ(cache.GetTableCount(), 3);
+
+	cache.Release(6);
+	EXPECT_EQ(cache.GetTableCount(), 2);
+	EXPECT_FALSE(cache.Find(6, 0, 1, &result));
+}
+
+TEST(MatchCacheTest, FingerprintCoversEveryNoteField) {
+	toccata::MusicSegment segment;
+	segment.NoteContainer.AddPoint({ 0, 60 });
+	segment.NoteContainer.AddPoint({ 100, 64 });
+
+	toccata::MusicPoint &point = segment.NoteContainer.GetPoints()[1];
+	point.Length = 50;
+	point.Velocity = 80;
+
+	const unsigned long long fingerprint = toccata::MatchCache::Fingerprint(&segment, 0, 1);
+	EXPECT_EQ(toccata::MatchCache::Fingerprint(&segment, 0, 1), fingerprint);
+
+	// Values moved from one field to another still change the content
+	point.Length = 80;
+	point.Velocity = 50;
+	const unsigned long long swapped = toccata::MatchCache::Fingerprint(&segment, 0, 1);
+	EXPECT_NE(swapped, fingerprint);
+
+	point.Pitch = 50;
+	point.Length = 64;
+	EXPECT_NE(toccata::MatchCache::Fingerprint(&segment, 0, 1), swapped);
+	EXPECT_NE(toccata::MatchCache::Fingerprint(&segment, 0, 1), fingerprint);
+}
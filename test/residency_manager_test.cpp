@@ -0,0 +1,106 @@
+#include <pch.h>
+
+#include "../include/residency_manager.h"
+#include "../include/library_file.h"
+#include "../include/song_generator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+	// Every section of the generated song becomes its own piece
+	void GenerateLibrary(toccata::Library *library, int pieces) {
+		toccata::SongGenerator songGenerator;
+		songGenerator.Seed(0);
+
+		for (int i = 0; i < pieces; ++i) {
+			const int firstBar = library->GetBarCount();
+			songGenerator.GenerateSong(library, 1, 64);
+
+			toccata::Piece *piece = library->NewPiece();
+			for (int j = firstBar; j < library->GetBarCount(); ++j) {
+				library->GetBar(j)->SetPiece(piece);
+			}
+		}
+	}
+
+} /* namespace */
+
+TEST(ResidencyManagerTest, EvictsLeastRecentlyUsed) {
+	const char *path = "residency_manager_test.tlib";
+
+	toccata::Library library;
+	GenerateLibrary(&library, 8);
+	library.CompileSummaries();
+	ASSERT_TRUE(toccata::LibraryFile::Write(&library, path));
+
+	toccata::LibraryFile file;
+	ASSERT_TRUE(file.Open(path));
+
+	toccata::Library loaded;
+	ASSERT_TRUE(file.Load(&loaded));
+
+	// Summaries come from the file
+	EXPECT_TRUE(loaded.GetBar(0)->GetSummary().Valid);
+	EXPECT_EQ(loaded.GetBar(0)->GetSummary().Pitches.size(), library.GetBar(0)->GetSummary().Pitches.size());
+
+	size_t pieceBytes[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4 * 64; ++i) {
+		pieceBytes[i / 64] += sizeof(toccata::MusicPoint) * loaded.GetBar(i)->GetSegment()->NoteContainer.GetCount();
+	}
+
+	// Room for the first piece and any one other piece
+	toccata::ResidencyManager residency;
+	residency.Initialize(
+		&loaded,
+		pieceBytes[0] + std::max(pieceBytes[1], std::max(pieceBytes[2], pieceBytes[3])));
+
+	EXPECT_FALSE(residency.Touch(loaded.GetBar(0)));
+	EXPECT_TRUE(residency.Touch(loaded.GetBar(1)));
+	EXPECT_FALSE(residency.Touch(loaded.GetBar(64)));
+	EXPECT_TRUE(residency.Touch(loaded.GetBar(0)));
+
+	// The second piece is the least recently used one
+	EXPECT_FALSE(residency.Touch(loaded.GetBar(128)));
+	EXPECT_TRUE(residency.IsResident(loaded.GetBar(0)));
+	EXPECT_FALSE(residency.IsResident(loaded.GetBar(64)));
+
+	residency.Prefetch(loaded.GetBar(192));
+	EXPECT_TRUE(residency.IsResident(loaded.GetBar(192)));
+
+	const toccata::ResidencyManager::Statistics statistics = residency.GetStatistics();
+	EXPECT_EQ(statistics.Hits, 2);
+	EXPECT_EQ(statistics.Misses, 3);
+	EXPECT_EQ(statistics.Prefetches, 1);
+	EXPECT_EQ(statistics.Evictions, 2);
+	EXPECT_EQ(statistics.ResidentPieces, 2);
+	EXPECT_LE(statistics.ResidentBytes, residency.GetBudget());
+
+	// The second piece and then the first one were evicted
+	std::vector<int> evicted;
+	residency.DrainEvicted(&evicted);
+	std::sort(evicted.begin(), evicted.end());
+	ASSERT_EQ(evicted.size(), 2 * 64);
+	EXPECT_EQ(evicted.front(), 0);
+	EXPECT_EQ(evicted.back(), 2 * 64 - 1);
+
+	evicted.clear();
+	residency.DrainEvicted(&evicted);
+	EXPECT_TRUE(evicted.empty());
+
+	// Evicted notes are read back from the file
+	for (int i = 64; i < 128; ++i) {
+		const toccata::MusicSegment *segment = library.GetBar(i)->GetSegment();
+		const toccata::MusicSegment *loadedSegment = loaded.GetBar(i)->GetSegment();
+		ASSERT_EQ(loadedSegment->NoteContainer.GetCount(), segment->NoteContainer.GetCount());
+
+		for (int j = 0; j < segment->NoteContainer.GetCount(); ++j) {
+			EXPECT_EQ(loadedSegment->NoteContainer.GetPoints()[j].Timestamp, segment->NoteContainer.GetPoints()[j].Timestamp);
+		}
+	}
+
+	file.Close();
+	std::remove(path);
+}
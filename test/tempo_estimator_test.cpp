@@ -0,0 +1,59 @@
+#include <pch.h>
+
+#include "../include/tempo_estimator.h"
+
+namespace {
+
+	void AddOnsets(toccata::MusicSegment *segment, const int *onsets, int count) {
+		segment->PulseUnit = 100.0;
+		segment->PulseRate = 1.0;
+
+		for (int i = 0; i < count; ++i) {
+			segment->NoteContainer.AddPoint({ onsets[i], 60 });
+		}
+
+		segment->Length = onsets[count - 1] + 100;
+	}
+
+} /* namespace */
+
+TEST(TempoEstimatorTest, MixedDurations) {
+	// Quarters and eighths with a chord and a little timing jitter
+	const int onsets[] = { 0, 0, 50, 101, 200, 249, 300, 398, 500, 550, 600, 601, 700, 751, 800 };
+
+	toccata::MusicSegment segment;
+	AddOnsets(&segment, onsets, sizeof(onsets) / sizeof(int));
+
+	toccata::TempoEstimator estimator;
+	const toccata::TempoEstimator::Estimate estimate =
+		estimator.EstimateTatum(&segment, 0, segment.NoteContainer.GetCount() - 1);
+
+	ASSERT_TRUE(estimate.Valid);
+	EXPECT_NEAR(estimate.Tatum, 0.5, 0.02);
+	EXPECT_GT(estimate.Confidence, 0.8);
+}
+
+TEST(TempoEstimatorTest, TooFewNotes) {
+	const int onsets[] = { 0, 100 };
+
+	toccata::MusicSegment segment;
+	AddOnsets(&segment, onsets, 2);
+
+	toccata::TempoEstimator estimator;
+	EXPECT_FALSE(estimator.EstimateTatum(&segment, 0, 1).Valid);
+}
+
+TEST(TempoEstimatorTest, Consistency) {
+	// Input played at 0.8 times the reference's speed, so s = 1.25 maps
+	// input time to reference time
+	EXPECT_TRUE(toccata::TempoEstimator::IsConsistent(0.5, 0.4, 1.25, 0.1));
+
+	// Reference in eighths, input in quarters
+	EXPECT_TRUE(toccata::TempoEstimator::IsConsistent(0.5, 0.8, 1.25, 0.1));
+
+	EXPECT_FALSE(toccata::TempoEstimator::IsConsistent(0.5, 0.4, 1.25 * 1.5, 0.1));
+	EXPECT_FALSE(toccata::TempoEstimator::IsConsistent(0.5, 0.4, 1.25 / 8, 0.1));
+
+	// Unknown tatums never reject
+	EXPECT_TRUE(toccata::TempoEstimator::IsConsistent(0.0, 0.4, 3.0, 0.1));
+}
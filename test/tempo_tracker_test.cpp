@@ -0,0 +1,50 @@
+#include <pch.h>
+
+#include "../include/tempo_tracker.h"
+
+#include <cmath>
+
+TEST(TempoTrackerTest, SteadyTempo) {
+	constexpr double BarLength = 4.0;
+	constexpr double Period = 1.25;
+
+	toccata::TempoTracker tracker;
+	EXPECT_FALSE(tracker.IsValid());
+
+	tracker.Update(10.0, Period);
+	EXPECT_TRUE(tracker.IsValid());
+
+	const double initialVariance = tracker.GetBoundaryVariance();
+
+	for (int i = 1; i < 16; ++i) {
+		tracker.Predict(BarLength);
+
+		// Predictions land on the next bar once the tempo is known
+		EXPECT_NEAR(tracker.GetBoundary(), 10.0 + i * BarLength * Period, 1E-6);
+		tracker.Update(10.0 + i * BarLength * Period, Period);
+	}
+
+	EXPECT_NEAR(tracker.GetPeriod(), Period, 1E-6);
+	EXPECT_LT(tracker.GetBoundaryVariance(), initialVariance);
+}
+
+TEST(TempoTrackerTest, TempoChange) {
+	constexpr double BarLength = 4.0;
+
+	toccata::TempoTracker tracker;
+	tracker.Initialize(0.0, 1.0);
+
+	// The player slows down by 10% and keeps that tempo
+	double boundary = 0.0;
+	for (int i = 0; i < 16; ++i) {
+		tracker.Predict(BarLength);
+
+		boundary += BarLength * ((i == 0) ? 1.0 : 1.1);
+		tracker.Update(boundary, 1.1);
+	}
+
+	EXPECT_NEAR(tracker.GetPeriod(), 1.1, 1E-3);
+
+	tracker.Predict(BarLength);
+	EXPECT_NEAR(tracker.GetBoundary(), boundary + BarLength * 1.1, 1E-2);
+}
@@ -0,0 +1,37 @@
+#include <pch.h>
+
+#include "../include/thread_utilities.h"
+#include "../include/memory.h"
+
+TEST(ThreadUtilitiesTest, DisabledSettingsChangeNothing) {
+	toccata::ThreadUtilities::RealtimeSettings settings;
+	settings.Policy = toccata::ThreadUtilities::SchedulingPolicy::Fifo;
+	settings.CpuMask = 1;
+
+	EXPECT_TRUE(toccata::ThreadUtilities::Apply(settings));
+	EXPECT_TRUE(toccata::ThreadUtilities::SetAffinity(0));
+}
+
+TEST(ThreadUtilitiesTest, LockKeepsContents) {
+	constexpr int n = 8;
+	constexpr int m = 5000;
+
+	int **memory = toccata::Memory::Allocate2d<int>(n, m);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < m; ++j) {
+			memory[i][j] = i * m + j;
+		}
+	}
+
+	// Locking is allowed to fail without enough permissions, but the
+	// memory has to be left as it was either way
+	toccata::ThreadUtilities::Lock2d(memory, m);
+
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < m; ++j) {
+			ASSERT_EQ(memory[i][j], i * m + j);
+		}
+	}
+
+	toccata::Memory::Free2d(memory);
+}